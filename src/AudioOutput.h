@@ -22,20 +22,16 @@
 #ifndef _AUDIO_OUTPUT_H
 #define _AUDIO_OUTPUT_H
 
-#ifdef with_sndfile
-#include <sndfile.h>
-#endif
-
 #include "drivers/AudioInterface.h"
+#include "AudioRecorder.h"
 #include "Config.h"
 #include "Thread.h"
 #include "main.h"
 
-typedef void (* AudioCallback)(float *buffer_l, float *buffer_r, unsigned num_frames, int stride);
-
 class GenericOutput
 {
 public:
+	GenericOutput () : config (NULL), mOutputFile ("/tmp/amSynth.wav") {}
 	virtual ~GenericOutput () {}
 
 	virtual void		setAudioCallback(AudioCallback callback) { mAudioCallback = callback; }
@@ -45,17 +41,26 @@ public:
 	virtual	bool		Start 			() = 0;
 	virtual	void		Stop			() = 0;
 	
-	virtual	bool		canRecord	( )	{ return false; }
-	virtual	void		startRecording	( )			{;}
-	virtual	void		stopRecording	( )			{;};
-	virtual	void		setOutputFile	( string /*file*/ )	{}
-	virtual	string		getOutputFile	( ) { return ""; }
+	// the output is recorded by mRecorder, which subclasses feed from their audio thread
+	virtual	bool		canRecord	( )	{ return config != NULL; }
+	virtual	void		startRecording	( )	{ if (config) mRecorder.start (mOutputFile, *config); }
+	virtual	void		stopRecording	( )	{ mRecorder.stop (); }
+	virtual	void		setOutputFile	( string file )	{ mOutputFile = file; }
+	virtual	string		getOutputFile	( ) { return mOutputFile; }
 
 
 	virtual	const char*	getTitle	( )	{ return "amSynth"; };
 
+	// Audio thread, for outputs which also receive MIDI (eg. JACK): passes the
+	// cycle's input due at or before frame to the MidiController, and returns the
+	// frame of the next pending message, or num_frames if none remain.
+	virtual	unsigned	dispatchMidi	( unsigned /*frame*/, unsigned num_frames ) { return num_frames; }
+
 protected:
 	AudioCallback mAudioCallback;
+	Config *config;				// set by init()
+	AudioRecorder mRecorder;
+	string mOutputFile;
 };
 
 class AudioOutput : public GenericOutput, public Thread
@@ -67,15 +72,6 @@ public:
 	bool	Start	();
 	void	Stop	();
 
-#ifdef with_sndfile
-	bool	canRecord	( )	{ return true; };
-#else
-	bool	canRecord	( )	{ return false; };
-#endif
-	void	startRecording	( );
-	void 	stopRecording	( );
-	void 	setOutputFile	( string file )	{ wavoutfile = file; };
-  	string 	getOutputFile	( )	{ return wavoutfile; };
 	int 	init		( Config & config );
 
 	void	ThreadAction	();
@@ -83,15 +79,8 @@ public:
 private:
   int running;
   int channels;
-  Config *config;
   AudioInterface out;
-  string wavoutfile;
-  int recording;
   float	*buffer;
-#ifdef with_sndfile
-  SNDFILE *sndfile;
-  SF_INFO sf_info;
-#endif
 };
 
 class NullAudioOutput : public GenericOutput { public:
@@ -0,0 +1,249 @@
+/*
+ *  AudioRecorder.cc
+ *
+ *  Copyright (c) 2001-2012 Nick Dowell
+ *
+ *  This file is part of amsynth.
+ *
+ *  amsynth is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  amsynth is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with amsynth.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "AudioRecorder.h"
+
+#include "Config.h"
+
+#include <fcntl.h>
+#include <iostream>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const unsigned kRingSeconds = 4;
+// a multiple of every frame size, so blocks are only written when full
+static const unsigned kDiskBufferSize = 192 * 1024;
+static const unsigned kHeaderSize = 44;
+
+AudioRecorder::AudioRecorder()
+:	mRing (NULL)
+,	mRingFrames (0)
+,	mWrite (0)
+,	mRead (0)
+,	mRecording (false)
+,	mWaitForSpace (false)
+,	mDroppedFrames (0)
+,	mFile (-1)
+,	mFormat (kFormatInt24)
+,	mBytesPerFrame (0)
+,	mSampleRate (0)
+,	mDataBytes (0)
+,	mDiskBuffer (NULL)
+,	mDiskBufferFill (0)
+,	mUseDither (false)
+{
+}
+
+AudioRecorder::~AudioRecorder()
+{
+	stop ();
+	free (mRing);
+	free (mDiskBuffer);
+}
+
+bool
+AudioRecorder::start		(const std::string &filename, const Config &config)
+{
+	stop ();
+
+	if (config.record_format == "float32") {
+		mFormat = kFormatFloat32;
+		mBytesPerFrame = 2 * 4;
+	} else if (config.record_format == "int16") {
+		mFormat = kFormatInt16;
+		mBytesPerFrame = 2 * 2;
+	} else {
+		mFormat = kFormatInt24;
+		mBytesPerFrame = 2 * 3;
+	}
+	mUseDither = config.audio_dither != 0;
+	mSampleRate = config.sample_rate;
+
+	unsigned frames = 1;
+	while (frames < mSampleRate * kRingSeconds)
+		frames *= 2;
+	if (frames != mRingFrames) {
+		free (mRing);
+		mRing = (float *) calloc (frames * 2, sizeof(float));
+		mRingFrames = frames;
+	}
+	if (!mDiskBuffer && posix_memalign ((void **) &mDiskBuffer, 4096, kDiskBufferSize) != 0)
+		mDiskBuffer = NULL;
+	if (!mRing || !mDiskBuffer)
+		return false;
+
+	mFile = open (filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (mFile == -1)
+		return false;
+	mDataBytes = 0;
+	mDiskBufferFill = 0;
+	writeHeader (); // updated with the final length by stop()
+	lseek (mFile, kHeaderSize, SEEK_SET);
+
+	mWrite = mRead = 0;
+	mDroppedFrames = 0;
+	if (Run () != 0) {
+		close (mFile);
+		mFile = -1;
+		return false;
+	}
+	__sync_synchronize();
+	mRecording = true;
+	return true;
+}
+
+void
+AudioRecorder::stop			()
+{
+	if (mFile == -1)
+		return;
+	mRecording = false;
+	Thread::Stop ();
+	Thread::Join ();
+	flush ();
+	writeHeader ();
+	close (mFile);
+	mFile = -1;
+	if (mDroppedFrames)
+		std::cerr << "amsynth: recording dropped " << mDroppedFrames << " frames" << std::endl;
+}
+
+void
+AudioRecorder::write		(const float *l, const float *r, unsigned frames, int stride)
+{
+	if (!mRecording)
+		return;
+	const unsigned write = mWrite;
+	while (mWaitForSpace && mRecording && mRingFrames - (write - mRead) < frames)
+		usleep (1000);
+	if (mRingFrames - (write - mRead) < frames) {
+		mDroppedFrames += frames;
+		return;
+	}
+	const unsigned mask = mRingFrames - 1;
+	for (unsigned i = 0; i < frames; i++) {
+		float *frame = mRing + ((write + i) & mask) * 2;
+		frame[0] = l[i * stride];
+		frame[1] = r[i * stride];
+	}
+	__sync_synchronize(); // publish the frames before the index
+	mWrite = write + frames;
+}
+
+void
+AudioRecorder::ThreadAction	()
+{
+	for (;;) {
+		// whatever was written before stop() was called is still written to disk
+		const bool stopping = ShouldStop ();
+		drain ();
+		if (stopping)
+			break;
+		usleep (20 * 1000);
+	}
+}
+
+// converts everything in the ring buffer into the disk buffer, writing it out each time it fills
+void
+AudioRecorder::drain		()
+{
+	const unsigned mask = mRingFrames - 1;
+	for (;;) {
+		const unsigned read = mRead;
+		__sync_synchronize();
+		unsigned frames = mWrite - read;
+		const unsigned contiguous = mRingFrames - (read & mask);
+		const unsigned space = (kDiskBufferSize - mDiskBufferFill) / mBytesPerFrame;
+		if (frames > contiguous) frames = contiguous;
+		if (frames > space) frames = space;
+		if (frames == 0)
+			return;
+
+		const float *src = mRing + (read & mask) * 2;
+		unsigned char *dst = mDiskBuffer + mDiskBufferFill;
+		switch (mFormat) {
+		case kFormatInt16:
+			float_to_s16 (src, (int16_t *) dst, frames * 2, mUseDither ? &mDither : NULL);
+			break;
+		case kFormatInt24:
+			float_to_s24_3le (src, dst, frames * 2, mUseDither ? &mDither : NULL);
+			break;
+		case kFormatFloat32:
+			memcpy (dst, src, frames * 2 * sizeof(float));
+			break;
+		}
+		mDiskBufferFill += frames * mBytesPerFrame;
+
+		__sync_synchronize(); // finish reading the frames before releasing them
+		mRead = read + frames;
+
+		if (mDiskBufferFill == kDiskBufferSize)
+			flush ();
+	}
+}
+
+void
+AudioRecorder::flush		()
+{
+	const unsigned char *data = mDiskBuffer;
+	unsigned size = mDiskBufferFill;
+	while (size) {
+		ssize_t written = ::write (mFile, data, size);
+		if (written <= 0)
+			break;
+		data += written;
+		size -= written;
+	}
+	mDataBytes += mDiskBufferFill - size;
+	mDiskBufferFill = 0;
+}
+
+static unsigned char *
+put_le (unsigned char *p, uint32_t value, unsigned bytes)
+{
+	for (unsigned i = 0; i < bytes; i++)
+		*p++ = (unsigned char)(value >> (8 * i));
+	return p;
+}
+
+void
+AudioRecorder::writeHeader	()
+{
+	const unsigned channels = 2;
+	const unsigned bits = mFormat == kFormatFloat32 ? 32 : mFormat == kFormatInt24 ? 24 : 16;
+	unsigned char header[kHeaderSize], *p = header;
+	memcpy (p, "RIFF", 4); p += 4;
+	p = put_le (p, 36 + mDataBytes, 4);
+	memcpy (p, "WAVEfmt ", 8); p += 8;
+	p = put_le (p, 16, 4);
+	p = put_le (p, mFormat == kFormatFloat32 ? 3 : 1, 2); // WAVE_FORMAT_IEEE_FLOAT or WAVE_FORMAT_PCM
+	p = put_le (p, channels, 2);
+	p = put_le (p, mSampleRate, 4);
+	p = put_le (p, mSampleRate * mBytesPerFrame, 4);
+	p = put_le (p, mBytesPerFrame, 2);
+	p = put_le (p, bits, 2);
+	memcpy (p, "data", 4); p += 4;
+	p = put_le (p, mDataBytes, 4);
+	if (pwrite (mFile, header, sizeof(header), 0) != sizeof(header))
+		std::cerr << "amsynth: could not write the WAV header" << std::endl;
+}
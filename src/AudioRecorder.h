@@ -0,0 +1,90 @@
+/*
+ *  AudioRecorder.h
+ *
+ *  Copyright (c) 2001-2012 Nick Dowell
+ *
+ *  This file is part of amsynth.
+ *
+ *  amsynth is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  amsynth is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with amsynth.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _AUDIO_RECORDER_H
+#define _AUDIO_RECORDER_H
+
+#include "Thread.h"
+#include "drivers/SampleConversion.h"
+
+#include <string>
+
+class Config;
+
+/**
+ * Records stereo audio to a WAV file without touching the disk from the audio
+ * thread: write() copies frames into a ring buffer, and a normal priority
+ * thread converts them to the output format and writes them out in large
+ * blocks.
+ */
+class AudioRecorder : public Thread
+{
+public:
+	AudioRecorder();
+	virtual ~AudioRecorder();
+
+	// Creates filename and starts recording into it with the sample rate and
+	// record_format of config. Returns false if the file can't be created.
+	bool	start			(const std::string &filename, const Config &config);
+	// Writes whatever is still buffered and closes the file.
+	void	stop			();
+	bool	isRecording		() const { return mRecording; }
+
+	// audio thread: frames are stride floats apart, as for VoiceAllocationUnit::Process()
+	void	write			(const float *l, const float *r, unsigned frames, int stride);
+
+	// When set, write() waits for the writer thread rather than dropping
+	// frames. Only for callers without realtime deadlines, eg JACK freewheeling.
+	void	setWaitForSpace	(bool wait) { mWaitForSpace = wait; }
+
+	// frames dropped because the ring buffer was full, since start()
+	unsigned long	getDroppedFrames	() const { return mDroppedFrames; }
+
+protected:
+	void	ThreadAction	();
+
+private:
+	enum Format { kFormatInt16, kFormatInt24, kFormatFloat32 };
+
+	void	drain			();
+	void	flush			();
+	void	writeHeader		();
+
+	float *			mRing;			// interleaved stereo
+	unsigned		mRingFrames;	// a power of two
+	volatile unsigned	mWrite;		// frame counters, wrapping
+	volatile unsigned	mRead;
+	volatile bool	mRecording;
+	volatile bool	mWaitForSpace;
+	volatile unsigned long	mDroppedFrames;
+
+	int				mFile;
+	Format			mFormat;
+	unsigned		mBytesPerFrame;
+	unsigned		mSampleRate;
+	unsigned long	mDataBytes;
+	unsigned char *	mDiskBuffer;
+	unsigned		mDiskBufferFill;
+	SampleDither	mDither;
+	bool			mUseDither;
+};
+
+#endif
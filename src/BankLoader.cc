@@ -0,0 +1,144 @@
+/*
+ *  BankLoader.cc
+ *
+ *  Copyright (c) 2001-2012 Nick Dowell
+ *
+ *  This file is part of amsynth.
+ *
+ *  amsynth is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  amsynth is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with amsynth.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "BankLoader.h"
+
+#include "PresetController.h"
+
+
+BankLoader::BankLoader()
+:	mPreset (-1)
+,	mRequested (false)
+,	mBusy (false)
+,	mJoinable (false)
+,	mLoaded (NULL)
+,	mSpent (NULL)
+{
+	pthread_mutex_init(&mMutex, NULL);
+	pthread_cond_init(&mIdle, NULL);
+}
+
+BankLoader::~BankLoader()
+{
+	pthread_mutex_lock(&mMutex);
+	mRequested = false; // a load not yet started is abandoned
+	pthread_mutex_unlock(&mMutex);
+	wait();
+	if (mJoinable)
+		Join();
+	delete mLoaded;
+	delete mSpent;
+	pthread_cond_destroy(&mIdle);
+	pthread_mutex_destroy(&mMutex);
+}
+
+PresetController *
+BankLoader::createBank(const char *filename)
+{
+	// loadPresets() only reads a binary bank's preset names, the values are read
+	// here so that selecting a preset on the audio thread never touches the disk
+	PresetController *bank = new PresetController;
+	if (bank->loadPresets(filename) != 0) {
+		delete bank;
+		return NULL;
+	}
+	bank->readAllPresets();
+	return bank;
+}
+
+void
+BankLoader::load(const std::string &filename, int preset)
+{
+	pthread_mutex_lock(&mMutex);
+	mFilename = filename;
+	mPreset = preset;
+	mRequested = true;
+	if (!mBusy) {
+		// the last thread has finished, or is about to
+		if (mJoinable)
+			Join();
+		mBusy = true;
+		mJoinable = (Run() == 0);
+		if (!mJoinable) {
+			mRequested = false;
+			mBusy = false;
+		}
+	}
+	pthread_mutex_unlock(&mMutex);
+}
+
+void
+BankLoader::wait()
+{
+	pthread_mutex_lock(&mMutex);
+	while (mBusy)
+		pthread_cond_wait(&mIdle, &mMutex);
+	pthread_mutex_unlock(&mMutex);
+}
+
+bool
+BankLoader::apply(PresetController &controller)
+{
+	if (mSpent)
+		return false; // the last bank's old presets haven't been freed yet, try again next time
+
+	PresetController *bank = __sync_lock_test_and_set(&mLoaded, (PresetController *)NULL);
+	if (!bank)
+		return false;
+
+	// the loader thread selects the requested preset in the loaded bank
+	int preset = bank->getCurrPresetNumber();
+	if (preset < 0)
+		preset = controller.getCurrPresetNumber();
+	controller.adoptPresets(*bank);
+	controller.selectPreset(preset);
+
+	__sync_synchronize();
+	mSpent = bank;
+	return true;
+}
+
+void
+BankLoader::ThreadAction()
+{
+	for (;;) {
+		delete __sync_lock_test_and_set(&mSpent, (PresetController *)NULL);
+
+		pthread_mutex_lock(&mMutex);
+		if (!mRequested) {
+			mBusy = false;
+			pthread_cond_broadcast(&mIdle);
+			pthread_mutex_unlock(&mMutex);
+			return;
+		}
+		const std::string filename = mFilename;
+		const int preset = mPreset;
+		mRequested = false;
+		pthread_mutex_unlock(&mMutex);
+
+		PresetController *bank = createBank(filename.c_str());
+		if (bank) {
+			bank->selectPreset(preset);
+			// a bank which was superseded before it was applied comes back to us
+			delete __sync_lock_test_and_set(&mLoaded, bank);
+		}
+	}
+}
@@ -0,0 +1,80 @@
+/*
+ *  BankLoader.h
+ *
+ *  Copyright (c) 2001-2012 Nick Dowell
+ *
+ *  This file is part of amsynth.
+ *
+ *  amsynth is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  amsynth is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with amsynth.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BANKLOADER_H
+#define _BANKLOADER_H
+
+#include "Thread.h"
+
+#include <pthread.h>
+#include <string>
+
+class PresetController;
+
+/**
+ * @brief Loads preset banks on a background thread.
+ *
+ * load() and wait() may be called from any thread except the audio thread.
+ * apply() hands a finished bank over to a PresetController by swapping
+ * pointers, it never locks or allocates so it may be called from the audio
+ * thread. The presets it replaces are freed by the next load(), on the loader
+ * thread, or by the destructor.
+ *
+ * The thread only runs while there is a bank to load, so a host with many
+ * plugin instances doesn't have one idle thread for each.
+ */
+class BankLoader : public Thread
+{
+public:
+			BankLoader		();
+			~BankLoader		();
+
+	// starts loading filename, superseding any bank not yet applied.
+	// preset is selected once the bank is applied, -1 keeps the current preset number.
+	void	load			(const std::string &filename, int preset = -1);
+
+	// blocks until any requested bank has been loaded (or failed to load)
+	void	wait			();
+
+	// if a bank is ready, swaps it into controller and returns true
+	bool	apply			(PresetController &controller);
+
+	// Reads a bank into a new PresetController with every preset in memory,
+	// or returns NULL if the file can't be loaded. Does not use the thread.
+	static PresetController *	createBank	(const char *filename);
+
+protected:
+	void	ThreadAction	();
+
+private:
+	pthread_mutex_t		mMutex;		// guards the request, never taken by apply()
+	pthread_cond_t		mIdle;
+	std::string			mFilename;
+	int					mPreset;
+	bool				mRequested;
+	bool				mBusy;		// the thread is running
+	bool				mJoinable;	// the thread has been started and not joined
+
+	PresetController * volatile	mLoaded;	// set by the loader thread, taken by apply()
+	PresetController * volatile	mSpent;		// set by apply(), freed by the loader thread
+};
+
+#endif
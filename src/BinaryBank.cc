@@ -0,0 +1,280 @@
+/*
+ *  BinaryBank.cc
+ *
+ *  Copyright (c) 2001-2012 Nick Dowell
+ *
+ *  This file is part of amsynth.
+ *
+ *  amsynth is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  amsynth is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with amsynth.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "BinaryBank.h"
+
+#include "controls.h"
+#include "Preset.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+static const char		kMagic[8] = { 'a', 'm', 'S', 'y', 'n', 't', 'h', 'B' };
+static const uint32_t	kByteOrderMark = 0x01020304;
+static const uint32_t	kVersion = 1;
+
+struct BinaryBankHeader
+{
+	char		magic[8];
+	uint32_t	byte_order;
+	uint32_t	version;
+	uint32_t	parameter_count;
+	uint32_t	preset_count;
+	uint32_t	parameter_names_offset;
+	uint32_t	index_offset;
+	uint32_t	strings_offset;
+	uint32_t	strings_size;
+	uint32_t	values_offset;
+	uint32_t	reserved;
+};
+
+struct BinaryBankString
+{
+	uint32_t	offset;		// relative to strings_offset
+	uint32_t	length;		// excluding the terminating NUL
+};
+
+struct BinaryBankIndexEntry
+{
+	BinaryBankString name;
+	uint32_t	values_offset;
+	uint32_t	reserved;
+};
+
+static inline size_t align16(size_t size) { return (size + 15) & ~(size_t)15; }
+
+BinaryBank::BinaryBank()
+:	mData (NULL)
+,	mSize (0)
+{
+}
+
+BinaryBank::~BinaryBank()
+{
+	close();
+}
+
+bool
+BinaryBank::isBinaryBank(const char *filename)
+{
+	char magic[sizeof(kMagic)];
+	FILE *file = fopen(filename, "rb");
+	if (!file)
+		return false;
+	size_t bytes_read = fread(magic, 1, sizeof(magic), file);
+	fclose(file);
+	return bytes_read == sizeof(magic) && memcmp(magic, kMagic, sizeof(magic)) == 0;
+}
+
+int
+BinaryBank::open(const char *filename)
+{
+	close();
+
+	int fd = ::open(filename, O_RDONLY);
+	if (fd == -1)
+		return -1;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(BinaryBankHeader)) {
+		::close(fd);
+		return -1;
+	}
+
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); // the mapping keeps its own reference to the file
+	if (data == MAP_FAILED)
+		return -1;
+
+	mData = (const unsigned char *)data;
+	mSize = st.st_size;
+
+	const BinaryBankHeader *header = (const BinaryBankHeader *)mData;
+	const uint64_t parameter_names_end = header->parameter_names_offset + (uint64_t)header->parameter_count * sizeof(BinaryBankString);
+	const uint64_t index_end = header->index_offset + (uint64_t)header->preset_count * sizeof(BinaryBankIndexEntry);
+	const uint64_t strings_end = header->strings_offset + (uint64_t)header->strings_size;
+	if (memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 ||
+		header->byte_order != kByteOrderMark ||
+		header->version != kVersion ||
+		parameter_names_end > mSize ||
+		index_end > mSize ||
+		strings_end > mSize ||
+		(header->parameter_names_offset % 4) ||
+		(header->index_offset % 4)) {
+		close();
+		return -1;
+	}
+
+	const BinaryBankString *param_names = (const BinaryBankString *)(mData + header->parameter_names_offset);
+	const char *strings = (const char *)(mData + header->strings_offset);
+	const uint64_t values_size = (uint64_t)header->parameter_count * sizeof(float);
+
+	const BinaryBankIndexEntry *index = (const BinaryBankIndexEntry *)(mData + header->index_offset);
+	for (uint32_t i = 0; i < header->preset_count; i++) {
+		if ((uint64_t)index[i].name.offset + index[i].name.length >= header->strings_size ||
+			index[i].values_offset + values_size > mSize ||
+			(index[i].values_offset % sizeof(float))) {
+			close();
+			return -1;
+		}
+	}
+
+	// resolve parameter names once per bank, rather than once per preset
+	mParamIds.resize(header->parameter_count);
+	for (uint32_t i = 0; i < header->parameter_count; i++) {
+		mParamIds[i] = -1;
+		if ((uint64_t)param_names[i].offset + param_names[i].length >= header->strings_size)
+			continue;
+		const char *name = strings + param_names[i].offset;
+		if (strlen(name) == param_names[i].length)
+			mParamIds[i] = parameter_index_from_name(name);
+	}
+
+	return 0;
+}
+
+void
+BinaryBank::close()
+{
+	if (mData)
+		munmap((void *)mData, mSize);
+	mData = NULL;
+	mSize = 0;
+	mParamIds.clear();
+}
+
+unsigned
+BinaryBank::getPresetCount() const
+{
+	return mData ? ((const BinaryBankHeader *)mData)->preset_count : 0;
+}
+
+std::string
+BinaryBank::getPresetName(unsigned index) const
+{
+	if (index >= getPresetCount())
+		return "";
+	const BinaryBankHeader *header = (const BinaryBankHeader *)mData;
+	const BinaryBankIndexEntry *entry = (const BinaryBankIndexEntry *)(mData + header->index_offset) + index;
+	return std::string((const char *)mData + header->strings_offset + entry->name.offset, entry->name.length);
+}
+
+bool
+BinaryBank::readPreset(unsigned index, Preset & preset) const
+{
+	if (index >= getPresetCount())
+		return false;
+	const BinaryBankHeader *header = (const BinaryBankHeader *)mData;
+	const BinaryBankIndexEntry *entry = (const BinaryBankIndexEntry *)(mData + header->index_offset) + index;
+	const float *values = (const float *)(mData + entry->values_offset);
+	for (uint32_t i = 0; i < header->parameter_count; i++) {
+		if (mParamIds[i] != -1)
+			preset.setValue(mParamIds[i], values[i]);
+	}
+	preset.setName(getPresetName(index));
+	return true;
+}
+
+int
+BinaryBank::write(const char *filename, const Preset *presets, unsigned count)
+{
+	const uint32_t parameter_count = kAmsynthParameterCount;
+
+	std::string strings;
+	std::vector<BinaryBankString> param_names(parameter_count);
+	for (uint32_t i = 0; i < parameter_count; i++) {
+		const std::string name = parameter_name_from_index(i);
+		param_names[i].offset = strings.size();
+		param_names[i].length = name.size();
+		strings += name;
+		strings += '\0';
+	}
+
+	std::vector<BinaryBankIndexEntry> index(count);
+	for (unsigned i = 0; i < count; i++) {
+		const std::string name = presets[i].getName();
+		memset(&index[i], 0, sizeof(index[i]));
+		index[i].name.offset = strings.size();
+		index[i].name.length = name.size();
+		strings += name;
+		strings += '\0';
+	}
+
+	// offsets are stored as 32 bit values
+	const size_t parameter_names_offset = align16(sizeof(BinaryBankHeader));
+	const size_t index_offset = align16(parameter_names_offset + parameter_count * sizeof(BinaryBankString));
+	const size_t strings_offset = align16(index_offset + count * sizeof(BinaryBankIndexEntry));
+	const size_t values_offset = align16(strings_offset + strings.size());
+	const size_t values_size = align16(parameter_count * sizeof(float));
+	const size_t file_size = values_offset + count * values_size;
+	if (file_size > 0xffffffffu)
+		return -1;
+
+	BinaryBankHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.byte_order = kByteOrderMark;
+	header.version = kVersion;
+	header.parameter_count = parameter_count;
+	header.preset_count = count;
+	header.parameter_names_offset = parameter_names_offset;
+	header.index_offset = index_offset;
+	header.strings_offset = strings_offset;
+	header.strings_size = strings.size();
+	header.values_offset = values_offset;
+
+	for (unsigned i = 0; i < count; i++)
+		index[i].values_offset = values_offset + i * values_size;
+
+	// sections are appended in file order, data.resize() zero fills the alignment padding
+	std::string data;
+	data.reserve(file_size);
+	data.append((const char *)&header, sizeof(header));
+	data.resize(parameter_names_offset);
+	data.append((const char *)&param_names[0], parameter_count * sizeof(BinaryBankString));
+	data.resize(index_offset);
+	if (count)
+		data.append((const char *)&index[0], count * sizeof(BinaryBankIndexEntry));
+	data.resize(strings_offset);
+	data.append(strings);
+	for (unsigned i = 0; i < count; i++) {
+		data.resize(index[i].values_offset);
+		for (uint32_t p = 0; p < parameter_count; p++) {
+			const float value = presets[i].getValue(p);
+			data.append((const char *)&value, sizeof(value));
+		}
+	}
+	data.resize(file_size);
+
+	FILE *file = fopen(filename, "wb");
+	if (!file)
+		return -1;
+	size_t written = fwrite(data.data(), 1, data.size(), file);
+	if (fclose(file) != 0 || written != data.size())
+		return -1;
+	return 0;
+}
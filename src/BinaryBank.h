@@ -0,0 +1,75 @@
+/*
+ *  BinaryBank.h
+ *
+ *  Copyright (c) 2001-2012 Nick Dowell
+ *
+ *  This file is part of amsynth.
+ *
+ *  amsynth is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  amsynth is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with amsynth.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BINARYBANK_H
+#define _BINARYBANK_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+class Preset;
+
+/**
+ * @brief A read-only, memory-mapped binary preset bank.
+ *
+ * File layout (native byte order, all offsets relative to the file start):
+ *
+ *   header        magic, byte order mark, version, counts and section offsets
+ *   param names   one { name offset, name length } pair per stored parameter
+ *   preset index  one { name offset, name length, values offset } per preset
+ *   strings       parameter and preset names, each NUL terminated
+ *   values        one float[parameter count] array per preset
+ *
+ * Opening a bank only maps the file and validates the header and index, the
+ * pages holding a preset's values are not touched until that preset is read.
+ */
+class BinaryBank
+{
+public:
+			BinaryBank		();
+			~BinaryBank		();
+
+	// returns 0 on success, -1 if the file can't be mapped or is not a valid binary bank
+	int		open			(const char *filename);
+	void	close			();
+	bool	isOpen			() const { return mData != NULL; }
+
+	unsigned	getPresetCount	() const;
+	std::string	getPresetName	(unsigned index) const;
+
+	// Copies the stored values into preset. Parameters missing from the file, ie. added
+	// to amsynth after it was written, keep their value in preset.
+	bool	readPreset		(unsigned index, Preset & preset) const;
+
+	// true if filename starts with the binary bank magic
+	static bool	isBinaryBank	(const char *filename);
+
+	// writes count presets to filename, returns 0 on success
+	static int	write			(const char *filename, const Preset *presets, unsigned count);
+
+private:
+	const unsigned char *	mData;
+	size_t					mSize;
+	std::vector<int>		mParamIds; // file parameter index -> Param, or -1 if unsupported
+};
+
+#endif
@@ -34,7 +34,8 @@ Config::Config()
 #ifndef _WIN32
 	amsynthrc_fname = string(getenv("HOME")) + string("/.amSynthrc");
 #endif
-	sample_rate = midi_channel = active_voices = polyphony = debug_drivers = xruns = 0;
+	sample_rate = midi_channel = active_voices = polyphony = polyphony_governor = huge_pages = lock_memory = isolate_audio_cpus = export_metrics = debug_drivers = xruns = audio_dither = 0;
+	dsp_load = 0;
 #ifdef ENABLE_REALTIME
 	realtime = 0;
 #endif
@@ -49,10 +50,17 @@ Config::Defaults	()
 	midi_channel = 0;
 	oss_audio_device = "/dev/dsp";
 	alsa_audio_device = "default";
+	audio_dither = 1;
+	record_format = "int24";
+	quality = "standard";
 	sample_rate = 44100;
 	channels = 2;
 	buffer_size = 128;
+	block_size = 64;
 	polyphony = 10;
+	polyphony_governor = 1;
+	audio_thread_scheduling = midi_thread_scheduling = worker_thread_scheduling = "default";
+	audio_thread_cpus = midi_thread_cpus = worker_thread_cpus = "all";
 	pitch_bend_range = 2;
 	alsa_seq_client_name = "amSynth";
 	current_bank_file = string (getenv ("HOME")) +
@@ -134,12 +142,51 @@ Config::load	()
 		} else if (buffer=="alsa_audio_device"){
 			file >> buffer;
 			alsa_audio_device = buffer;
+		} else if (buffer=="audio_dither"){
+			file >> buffer;
+			istringstream(buffer) >> audio_dither;
+		} else if (buffer=="record_format"){
+			file >> buffer;
+			record_format = buffer;
+		} else if (buffer=="quality"){
+			file >> buffer;
+			quality = buffer;
+		} else if (buffer=="export_metrics"){
+			file >> buffer;
+			istringstream(buffer) >> export_metrics;
 		} else if (buffer=="sample_rate"){
 			file >> buffer;
 			istringstream(buffer) >> sample_rate;
+		} else if (buffer=="block_size"){
+			file >> buffer;
+			istringstream(buffer) >> block_size;
 		} else if (buffer=="polyphony"){
 			file >> buffer;
 			istringstream(buffer) >> polyphony;
+		} else if (buffer=="polyphony_governor"){
+			file >> buffer;
+			istringstream(buffer) >> polyphony_governor;
+		} else if (buffer=="huge_pages"){
+			file >> buffer;
+			istringstream(buffer) >> huge_pages;
+		} else if (buffer=="lock_memory"){
+			file >> buffer;
+			istringstream(buffer) >> lock_memory;
+		} else if (buffer=="audio_thread_scheduling"){
+			file >> audio_thread_scheduling;
+		} else if (buffer=="midi_thread_scheduling"){
+			file >> midi_thread_scheduling;
+		} else if (buffer=="worker_thread_scheduling"){
+			file >> worker_thread_scheduling;
+		} else if (buffer=="audio_thread_cpus"){
+			file >> audio_thread_cpus;
+		} else if (buffer=="midi_thread_cpus"){
+			file >> midi_thread_cpus;
+		} else if (buffer=="worker_thread_cpus"){
+			file >> worker_thread_cpus;
+		} else if (buffer=="isolate_audio_cpus"){
+			file >> buffer;
+			istringstream(buffer) >> isolate_audio_cpus;
 		} else if (buffer=="pitch_bend_range"){
 			file >> buffer;
 			istringstream(buffer) >> pitch_bend_range;
@@ -162,8 +209,23 @@ Config::save	()
 	fprintf (fout, "audio_driver\t%s\n", audio_driver.c_str());
 	fprintf (fout, "oss_audio_device\t%s\n", oss_audio_device.c_str());
 	fprintf (fout, "alsa_audio_device\t%s\n", alsa_audio_device.c_str());
+	fprintf (fout, "audio_dither\t%d\n", audio_dither);
+	fprintf (fout, "record_format\t%s\n", record_format.c_str());
+	fprintf (fout, "quality\t%s\n", quality.c_str());
+	fprintf (fout, "export_metrics\t%d\n", export_metrics);
 	fprintf (fout, "sample_rate\t%d\n", sample_rate);
+	fprintf (fout, "block_size\t%d\n", block_size);
 	fprintf (fout, "polyphony\t%d\n", polyphony);
+	fprintf (fout, "polyphony_governor\t%d\n", polyphony_governor);
+	fprintf (fout, "huge_pages\t%d\n", huge_pages);
+	fprintf (fout, "lock_memory\t%d\n", lock_memory);
+	fprintf (fout, "audio_thread_scheduling\t%s\n", audio_thread_scheduling.c_str());
+	fprintf (fout, "midi_thread_scheduling\t%s\n", midi_thread_scheduling.c_str());
+	fprintf (fout, "worker_thread_scheduling\t%s\n", worker_thread_scheduling.c_str());
+	fprintf (fout, "audio_thread_cpus\t%s\n", audio_thread_cpus.c_str());
+	fprintf (fout, "midi_thread_cpus\t%s\n", midi_thread_cpus.c_str());
+	fprintf (fout, "worker_thread_cpus\t%s\n", worker_thread_cpus.c_str());
+	fprintf (fout, "isolate_audio_cpus\t%d\n", isolate_audio_cpus);
 	fprintf (fout, "pitch_bend_range\t%d\n", pitch_bend_range);
 	fclose (fout);
 	return 0;
@@ -62,7 +62,8 @@ public:
 	int current_audio_driver_wants_realtime;
 #endif
 	/**
-	 * A count of the number of voices currently active and producing a signal
+	 * A count of the number of voices currently active and producing a signal,
+	 * updated while export_metrics is enabled
 	 */
 	int active_voices;
 	/**
@@ -73,6 +74,11 @@ public:
 	 * erm..
 	 */
 	int buffer_size;
+	/**
+	 * The number of frames the synthesis engine renders at a time, from 1 to
+	 * 256. Modulation is updated once per block.
+	 */
+	int block_size;
 	/**
 	 * Used to specify the maximum number of voices allowed to be active 
 	 * simultaneously. Attempting to play too many voices simultaneously will
@@ -80,6 +86,37 @@ public:
 	 * unlimited polyphony.
 	 */
 	int polyphony;
+	/**
+	 * Set to 1 to lower the polyphony temporarily when rendering can't keep up
+	 */
+	int polyphony_governor;
+	/**
+	 * Set to 1 to allocate the synthesis engine's memory from huge pages,
+	 * which must have been reserved with /proc/sys/vm/nr_hugepages
+	 */
+	int huge_pages;
+	/**
+	 * Set to 1 to lock all of amsynth's memory into RAM with mlockall()
+	 */
+	int lock_memory;
+	/**
+	 * How the audio, MIDI input and worker (disk i/o) threads are scheduled:
+	 * "default" (inherited), "other", "batch", "idle", "fifo:<priority>" or
+	 * "rr:<priority>". See ThreadSchedule
+	 */
+	std::string audio_thread_scheduling;
+	std::string midi_thread_scheduling;
+	std::string worker_thread_scheduling;
+	/**
+	 * The CPUs each kind of thread may run on, "all" or a list like "2,4-5"
+	 */
+	std::string audio_thread_cpus;
+	std::string midi_thread_cpus;
+	std::string worker_thread_cpus;
+	/**
+	 * Set to 1 to keep every other thread off audio_thread_cpus
+	 */
+	int isolate_audio_cpus;
 	/*
 	 */
 	int pitch_bend_range;
@@ -107,6 +144,22 @@ public:
 	 * The name of the ALSA PCM device to use
 	 */
 	std::string alsa_audio_device;
+	/**
+	 * Set to 1 to add TPDF dither when audio is output with 24 bits or fewer
+	 */
+	int audio_dither;
+	/**
+	 * The sample format of recordings: "int16", "int24" or "float32"
+	 */
+	std::string record_format;
+	/**
+	 * Synthesis quality: "eco", "standard" or "high"
+	 */
+	std::string quality;
+	/**
+	 * Set to 1 to publish live statistics for amsynth-stat, see Metrics.h
+	 */
+	int export_metrics;
 	
 	std::string	current_bank_file;
 
@@ -120,6 +173,8 @@ public:
 	int	debug_drivers;
 	// used to count buffer underruns
 	int	xruns;
+	// DSP load in percent, for audio drivers which report it
+	float	dsp_load;
 };
 
 #endif
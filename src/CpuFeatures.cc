@@ -0,0 +1,78 @@
+/*
+ *  CpuFeatures.cc
+ *
+ *  Copyright (c) 2001-2012 Nick Dowell
+ *
+ *  This file is part of amsynth.
+ *
+ *  amsynth is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  amsynth is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with amsynth.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CpuFeatures.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static unsigned
+detect ()
+{
+	unsigned features = 0;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	__builtin_cpu_init ();
+	if (__builtin_cpu_supports ("sse2"))
+		features |= kCpuSSE2;
+	if (__builtin_cpu_supports ("avx2"))
+		features |= kCpuAVX2;
+	if (__builtin_cpu_supports ("avx512f"))
+		features |= kCpuAVX512F;
+#endif
+	const char *limit = getenv ("AMSYNTH_CPU");
+	if (limit) {
+		if (strcmp (limit, "generic") == 0)
+			features = 0;
+		else if (strcmp (limit, "sse2") == 0)
+			features &= kCpuSSE2;
+		else if (strcmp (limit, "avx2") == 0)
+			features &= kCpuSSE2 | kCpuAVX2;
+	}
+	return features;
+}
+
+unsigned
+cpu_features ()
+{
+	static int features = -1;
+	if (features == -1)
+		features = detect (); // a race here is harmless, every thread finds the same
+	return features;
+}
+
+const char *
+cpu_feature_name (unsigned features)
+{
+	if (features & kCpuAVX512F) return "avx512f";
+	if (features & kCpuAVX2) return "avx2";
+	if (features & kCpuSSE2) return "sse2";
+	return "generic";
+}
+
+std::string
+cpu_features_string (unsigned features)
+{
+	std::string s;
+	if (features & kCpuSSE2) s += "sse2 ";
+	if (features & kCpuAVX2) s += "avx2 ";
+	if (features & kCpuAVX512F) s += "avx512f ";
+	return s.empty() ? "none" : s.substr (0, s.size() - 1);
+}
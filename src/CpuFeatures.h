@@ -0,0 +1,45 @@
+/*
+ *  CpuFeatures.h
+ *
+ *  Copyright (c) 2001-2012 Nick Dowell
+ *
+ *  This file is part of amsynth.
+ *
+ *  amsynth is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  amsynth is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with amsynth.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CPU_FEATURES_H
+#define _CPU_FEATURES_H
+
+#include <string>
+
+// instruction set extensions which DSP kernels are built for
+enum {
+	kCpuSSE2	= 1 << 0,
+	kCpuAVX2	= 1 << 1,
+	kCpuAVX512F	= 1 << 2,
+};
+
+// Returns the extensions supported by the CPU and operating system, detected
+// once with cpuid. Setting the environment variable AMSYNTH_CPU to "generic",
+// "sse2" or "avx2" limits them, to compare kernels on one machine.
+unsigned	cpu_features	();
+
+// the best of the given extensions, for reporting a kernel's selection
+const char *	cpu_feature_name	(unsigned features);
+
+// e.g. "sse2 avx2"
+std::string	cpu_features_string	(unsigned features);
+
+#endif
@@ -65,6 +65,14 @@ int main(int argc, char *argv[])
 	printf("with denormals:                %.2f\n", best_test_time( true, false, 1) / 1000000.f);
 	printf("with denormals, tested for:    %.2f\n", best_test_time( true,  true, 1) / 1000000.f);
 #if __SSE2_MATH__
+	{
+		DenormalGuard guard;
+		printf("inside DenormalGuard:          %.2f\n", best_test_time( true, false, 5) / 1000000.f);
+	}
+#ifndef NDEBUG
+	printf("guarded blocks with denormals: %lu\n", denormal_incidence());
+#endif
+	printf("MXCSR restored:                %s\n", (_mm_getcsr() & kMXCSR_FTZ_DAZ) ? "no" : "yes");
 	disable_denormals();
 	printf("with denormals-as-zero (SSE2): %.2f\n", best_test_time( true, false, 5) / 1000000.f);
 #endif
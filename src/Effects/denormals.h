@@ -25,13 +25,63 @@
 #define undenormalise(s) if ((s) < FLT_MIN) { (s) = 0.0f; }
 #endif
 
+#if __SSE2_MATH__
+enum {
+	kMXCSR_FTZ_DAZ = 0x8040,
+	kMXCSR_DenormalFlags = 0x0012, // 'Denormal Operand' and 'Underflow' exceptions
+};
+#endif
+
 static inline void disable_denormals()
 {
 #if __SSE2_MATH__
-	_mm_setcsr(_mm_getcsr() | 0x8040);
+	_mm_setcsr(_mm_getcsr() | kMXCSR_FTZ_DAZ);
 #endif
 }
 
+#ifndef NDEBUG
+// The number of DenormalGuard scopes in which a denormal number was produced
+// (and flushed to zero) or consumed. Always 0 without SSE2 math.
+inline unsigned long &denormal_incidence()
+{
+	static unsigned long count = 0;
+	return count;
+}
+#endif
+
+//
+// Audio callbacks which may be called on threads we didn't create (a plugin
+// host's, or JACK's) should put one of these on the stack. It sets FZ and DAZ
+// for the rest of the scope, then restores the thread's previous MXCSR.
+//
+class DenormalGuard
+{
+public:
+	DenormalGuard()
+	{
+#if __SSE2_MATH__
+		_mxcsr = _mm_getcsr();
+		_mm_setcsr((_mxcsr | kMXCSR_FTZ_DAZ) & ~kMXCSR_DenormalFlags);
+#endif
+	}
+
+	~DenormalGuard()
+	{
+#if __SSE2_MATH__
+#ifndef NDEBUG
+		if (_mm_getcsr() & kMXCSR_DenormalFlags)
+			__sync_add_and_fetch(&denormal_incidence(), 1);
+#endif
+		_mm_setcsr(_mxcsr);
+#endif
+	}
+
+private:
+#if __SSE2_MATH__
+	unsigned int _mxcsr;
+#endif
+};
+
 #endif//_denormals_
 
 //ends
@@ -5,6 +5,7 @@
 // This code is public domain
 
 #include <iostream>
+#include <math.h>
 #include "revmodel.hpp"
 
 revmodel::revmodel()
@@ -44,6 +45,7 @@ revmodel::revmodel()
 	allpassR[2].setfeedback(0.5f);
 	allpassL[3].setfeedback(0.5f);
 	allpassR[3].setfeedback(0.5f);
+	activecombs = numcombs;
 	setwet(initialwet);
 	setroomsize(initialroom);
 	setdry(initialdry);
@@ -74,7 +76,7 @@ void revmodel::mute()
 }
 
 void 
-revmodel::processreplace(float *inputL, float *inputR, float *outputL, float *outputR, long numsamples, int skip)
+revmodel::processreplace(float *inputL, float *inputR, float *outputL, float *outputR, long numsamples, int stride_in, int stride_out)
 {
 	float outL,outR,input;
 	int i;
@@ -85,7 +87,7 @@ revmodel::processreplace(float *inputL, float *inputR, float *outputL, float *ou
 		input = (*inputL) * gain;
 
 		// Accumulate comb filters in parallel
-		for(i=0; i<numcombs; i++)
+		for(i=0; i<activecombs; i++)
 		{
 			outL += combL[i].process(input);
 			outR += combR[i].process(input);
@@ -103,10 +105,10 @@ revmodel::processreplace(float *inputL, float *inputR, float *outputL, float *ou
 		*outputR = outR*wet1 + outL*wet2 + *inputR*dry;
 
 		// Increment sample pointers, allowing for interleave (if any)
-		inputL += skip;
-		inputR += skip;
-		outputL += skip;
-		outputR += skip;
+		inputL += stride_in;
+		inputR += stride_in;
+		outputL += stride_out;
+		outputR += stride_out;
 	}
 }
 
@@ -122,7 +124,7 @@ revmodel::processreplace(float *inputM, float *outputL, float *outputR, long num
 		input = (*inputM) * gain;
 
 		// Accumulate comb filters in parallel
-		for(i=0; i<numcombs; i++)
+		for(i=0; i<activecombs; i++)
 		{
 			outL += combL[i].process(input);
 			outR += combR[i].process(input);
@@ -146,7 +148,7 @@ revmodel::processreplace(float *inputM, float *outputL, float *outputR, long num
 	}
 }
 
-void revmodel::processmix(float *inputL, float *inputR, float *outputL, float *outputR, long numsamples, int skip)
+void revmodel::processmix(float *inputL, float *inputR, float *outputL, float *outputR, long numsamples, int stride_in, int stride_out)
 {
 	float outL,outR,input;
 
@@ -156,7 +158,7 @@ void revmodel::processmix(float *inputL, float *inputR, float *outputL, float *o
 		input = (*inputL + *inputR) * gain;
 
 		// Accumulate comb filters in parallel
-		for(int i=0; i<numcombs; i++)
+		for(int i=0; i<activecombs; i++)
 		{
 			outL += combL[i].process(input);
 			outR += combR[i].process(input);
@@ -174,10 +176,10 @@ void revmodel::processmix(float *inputL, float *inputR, float *outputL, float *o
 		*outputR += outR*wet1 + outL*wet2 + *inputR*dry;
 
 		// Increment sample pointers, allowing for interleave (if any)
-		inputL += skip;
-		inputR += skip;
-		outputL += skip;
-		outputR += skip;
+		inputL += stride_in;
+		inputR += stride_in;
+		outputL += stride_out;
+		outputR += stride_out;
 	}
 }
 
@@ -200,7 +202,7 @@ void revmodel::update()
 	{
 		roomsize1 = roomsize;
 		damp1 = damp;
-		gain = fixedgain;
+		gain = fixedgain * sqrtf((float)numcombs / activecombs); // similar level with fewer combs
 	}
 
 	for(i=0; i<numcombs; i++)
@@ -216,6 +218,20 @@ void revmodel::update()
 	}
 }
 
+void revmodel::setcombcount(int count)
+{
+	if (count < 1) count = 1;
+	if (count > numcombs) count = numcombs;
+	// combs coming back into use still hold the tail from when they were dropped
+	for (int i=activecombs; i<count; i++)
+	{
+		combL[i].mute();
+		combR[i].mute();
+	}
+	activecombs = count;
+	update();
+}
+
 // The following get/set functions are not inlined, because
 // speed is never an issue when calling them, and also
 // because as you develop the reverb model, you may
@@ -16,8 +16,9 @@ class revmodel
 public:
 	revmodel();
     void    mute();
-    void    processmix(float *inputL, float *inputR, float *outputL, float *outputR, long numsamples, int skip);
-    void    processreplace(float *inputL, float *inputR, float *outputL, float *outputR, long numsamples, int skip);
+    // stride_in and stride_out are the distances between consecutive samples, 1 for planar buffers
+    void    processmix(float *inputL, float *inputR, float *outputL, float *outputR, long numsamples, int stride_in, int stride_out);
+    void    processreplace(float *inputL, float *inputR, float *outputL, float *outputR, long numsamples, int stride_in, int stride_out);
     void    processreplace(float *inputM, float *outputL, float *outputR, long numsamples, int stride_in, int stride_out);
     void    setroomsize(float value);
     float   getroomsize();
@@ -31,6 +32,8 @@ public:
     float   getwidth();
     void    setmode(float value);
     float   getmode();
+    // uses only the first count comb filters, which is cheaper but less dense
+    void    setcombcount(int count);
 private:
 	void    update();
 private:
@@ -41,6 +44,7 @@ private:
  float   dry;
    float   width;
  float   mode;
+    int     activecombs;
 
  // The following are all declared inline 
       // to remove the need for dynamic allocation
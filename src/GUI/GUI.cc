@@ -43,6 +43,7 @@ using namespace Gtk;
 #include "../MidiController.h"
 #include "../Preset.h"
 #include "../VoiceAllocationUnit.h"
+#include "../main.h"
 
 #include "../../config.h"
 #include "amsynth_logo.h"
@@ -885,7 +886,7 @@ GUI::bank_open		( )
 	{
 		preset_controller->savePresets (config->current_bank_file.c_str ());
 		config->current_bank_file = dlg.get_filename ();
-		preset_controller->loadPresets (config->current_bank_file.c_str ());
+		amsynth_load_bank (config->current_bank_file.c_str ());
 	}
 }
 
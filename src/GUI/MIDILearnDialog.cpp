@@ -66,7 +66,7 @@ MIDILearnDialog::run_modal(unsigned param_idx)
 	gtk_spin_button_set_value(GTK_SPIN_BUTTON(_ccSpinButton),
 		_midiController->getControllerForParam(param.GetId()));
 	
-	_midiController->getLastControllerParam().addUpdateListener(*this);
+	_midiController->setLastActiveControllerListener(this);
 
 	gtk_widget_show_all(_dialog);
 	const gint response = gtk_dialog_run(GTK_DIALOG(_dialog));
@@ -78,7 +78,7 @@ MIDILearnDialog::run_modal(unsigned param_idx)
 			_midiController->setController(midi_cc, param);
 	}
 
-	_midiController->getLastControllerParam().removeUpdateListener(*this);
+	_midiController->setLastActiveControllerListener(NULL);
 }
 
 void
@@ -90,7 +90,7 @@ MIDILearnDialog::update()
 void
 MIDILearnDialog::last_active_controller_changed()
 {
-	int value = (int)_midiController->getLastControllerParam().getValue();
+	int value = _midiController->getLastActiveController();
 	gtk_spin_button_set_value(GTK_SPIN_BUTTON(_ccSpinButton), value);
 }
 
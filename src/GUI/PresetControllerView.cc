@@ -22,6 +22,7 @@
 #include "PresetControllerView.h"
 
 #include "../PresetController.h"
+#include "../main.h"
 #include "../VoiceAllocationUnit.h"
 
 #include <fstream>
@@ -36,6 +37,7 @@ class PresetControllerViewImpl : public PresetControllerView, public UpdateListe
 {
 public:
 	PresetControllerViewImpl(VoiceAllocationUnit *voiceAllocationUnit);
+	~PresetControllerViewImpl();
 
 	virtual void setPresetController(PresetController *presetController);
 	virtual void update();
@@ -48,6 +50,7 @@ private:
 	static void on_audition_pressed (GtkWidget *widget, PresetControllerViewImpl *);
 	static void on_audition_released (GtkWidget *widget, PresetControllerViewImpl *);
 	static void on_panic_clicked (GtkWidget *widget, PresetControllerViewImpl *);
+	static gboolean on_timeout (PresetControllerViewImpl *);
 
 	VoiceAllocationUnit *vau;
     PresetController *presetController;
@@ -55,6 +58,8 @@ private:
 	GtkWidget *combo;
 	GtkWidget *save_button;
 	bool inhibit_combo_callback;
+	std::vector<std::string> bank_paths;	// the banks listed in bank_combo
+	guint timeout_id;
 };
 
 PresetControllerViewImpl::PresetControllerViewImpl(VoiceAllocationUnit *voiceAllocationUnit)
@@ -64,6 +69,9 @@ PresetControllerViewImpl::PresetControllerViewImpl(VoiceAllocationUnit *voiceAll
 ,	combo(NULL)
 ,	inhibit_combo_callback(false)
 {
+	// picks up the bank list once the background scan has finished
+	timeout_id = g_timeout_add (500, (GSourceFunc) &PresetControllerViewImpl::on_timeout, this);
+
 	bank_combo = gtk_combo_box_new_text ();
 	g_signal_connect (G_OBJECT (bank_combo), "changed", G_CALLBACK (&PresetControllerViewImpl::on_combo_changed), this);
 	add (* Glib::wrap (bank_combo));
@@ -93,6 +101,11 @@ PresetControllerViewImpl::PresetControllerViewImpl(VoiceAllocationUnit *voiceAll
 	add (* Glib::wrap (widget));
 }
 
+PresetControllerViewImpl::~PresetControllerViewImpl()
+{
+	g_source_remove (timeout_id);
+}
+
 void PresetControllerViewImpl::setPresetController(PresetController *presetController)
 {
     this->presetController = presetController;
@@ -106,8 +119,12 @@ void PresetControllerViewImpl::on_combo_changed (GtkWidget *widget, PresetContro
 
 	if (widget == that->bank_combo) {
 		gint bank = gtk_combo_box_get_active (GTK_COMBO_BOX (that->bank_combo));
-		const std::vector<BankInfo> banks = PresetController::getPresetBanks();
-		that->presetController->loadPresets(banks[bank].file_path.c_str());
+		if (bank < 0 || (size_t) bank >= that->bank_paths.size())
+			return;
+		// loaded in the background, see amsynth_timer_callback()
+		gint preset = gtk_combo_box_get_active (GTK_COMBO_BOX (that->combo));
+		amsynth_load_bank_preset (that->bank_paths[bank].c_str(), preset);
+		return;
 	}
 
 	gint preset = gtk_combo_box_get_active (GTK_COMBO_BOX (that->combo));
@@ -118,6 +135,7 @@ void PresetControllerViewImpl::on_combo_changed (GtkWidget *widget, PresetContro
 void PresetControllerViewImpl::on_combo_popup_shown (GObject *gobject, GParamSpec *pspec, PresetControllerViewImpl *that)
 {
 	that->presetController->loadPresets();
+	that->presetController->readAllPresets(); // MIDI program changes select presets on the audio thread
 }
 
 void PresetControllerViewImpl::on_save_clicked (GtkWidget *widget, PresetControllerViewImpl *that)
@@ -143,6 +161,13 @@ void PresetControllerViewImpl::on_panic_clicked (GtkWidget *widget, PresetContro
 	that->vau->HandleMidiAllSoundOff();
 }
 
+gboolean PresetControllerViewImpl::on_timeout (PresetControllerViewImpl *that)
+{
+	if (that->presetController && PresetController::updatePresetBanks())
+		that->update();
+	return TRUE;
+}
+
 void PresetControllerViewImpl::update()
 {
 	inhibit_combo_callback = true;
@@ -154,7 +179,9 @@ void PresetControllerViewImpl::update()
 	// bank combo
 
 	gtk_list_store_clear (GTK_LIST_STORE (gtk_combo_box_get_model (GTK_COMBO_BOX (bank_combo))));
+	bank_paths.clear();
 	for (size_t i=0; i<banks.size(); i++) {
+		bank_paths.push_back (banks[i].file_path);
 		snprintf (text, sizeof(text), "[%s] %s", banks[i].read_only ? "factory" : "user", banks[i].name.c_str());
 		gtk_combo_box_insert_text (GTK_COMBO_BOX (bank_combo), i, text);
 	}
@@ -21,7 +21,8 @@
 
 #include "JackOutput.h"
 #include "VoiceAllocationUnit.h"
-#include "drivers/MidiInterface.h" // for class MidiStreamReceiver
+#include "MidiController.h"
+#include "Thread.h"
 
 #if HAVE_JACK_MIDIPORT_H
 #include <jack/midiport.h>
@@ -51,6 +52,8 @@ JackOutput::JackOutput()
 ,	client(NULL)
 #endif
 ,	_midiHandler(NULL)
+,	_midiMessageCount(0)
+,	_midiMessageNext(0)
 {
 }
 
@@ -80,6 +83,11 @@ JackOutput::init	( Config & config )
 	}
 	
 	jack_set_process_callback(client, &JackOutput::process, this);
+	jack_set_buffer_size_callback(client, &JackOutput::buffer_size_changed, this);
+	jack_set_sample_rate_callback(client, &JackOutput::sample_rate_changed, this);
+	jack_set_xrun_callback(client, &JackOutput::xrun, this);
+	jack_set_freewheel_callback(client, &JackOutput::freewheel, this);
+	jack_set_thread_init_callback(client, &JackOutput::thread_init, this);
 
 	/* create output ports */
 	l_port = jack_port_register(client, "L out", JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
@@ -98,6 +106,7 @@ JackOutput::init	( Config & config )
 	config.sample_rate = jack_get_sample_rate(client);
 	config.buffer_size = jack_get_buffer_size(client);
 	config.jack_client_name = std::string(jack_get_client_name(client));
+	this->config = &config;
 
 	// don't auto connect ports if under jack session control...
 	// the jack session manager is responsible for restoring port connections
@@ -121,22 +130,103 @@ JackOutput::process (jack_nframes_t nframes, void *arg)
 	if (self->m_port) {
 		void *port_buf = jack_port_get_buffer(self->m_port, nframes);
 		const jack_nframes_t event_count = jack_midi_get_event_count(port_buf);
+		// the messages are applied at their frames by dispatchMidi(), called back
+		// from the audio callback as it renders the cycle
+		MidiMessage *messages = self->_midiMessages;
+		const unsigned capacity = sizeof(self->_midiMessages) / sizeof(self->_midiMessages[0]);
+		unsigned message_count = 0;
 		for (jack_nframes_t i=0; i<event_count; i++) {
 			jack_midi_event_t midi_event;
 			memset(&midi_event, 0, sizeof(midi_event));
 			jack_midi_event_get(&midi_event, port_buf, i);
-			if (midi_event.size && midi_event.buffer) {
-				// TODO: use midi_event.time to reduce midi event jitter
-				self->_midiHandler->HandleMidiData(midi_event.buffer, midi_event.size);
+			for (size_t j=0; j<midi_event.size && midi_event.buffer; j++) {
+				MidiMessage &message = messages[message_count];
+				if (!self->_midiDecoder.decode(midi_event.buffer[j], message))
+					continue;
+				message.frame = midi_event.time < nframes ? midi_event.time : nframes - 1;
+				if (++message_count == capacity) {
+					// too many for one cycle: what has been decoded so far takes effect at its start
+					self->_midiHandler->HandleMidiMessages(messages, message_count);
+					message_count = 0;
+				}
 			}
 		}
+		self->_midiMessageCount = message_count;
+		self->_midiMessageNext = 0;
 	}
 #endif
 	if (self->mAudioCallback != NULL) {
 		(*self->mAudioCallback)(lout, rout, nframes, 1);
 	}
+	self->mRecorder.write(lout, rout, nframes, 1);
+	self->config->dsp_load = jack_cpu_load(self->client);
 	return 0;
 }
+
+unsigned
+JackOutput::dispatchMidi	( unsigned frame, unsigned num_frames )
+{
+	// the messages due at frame are one batch, see MidiController::HandleMidiMessages()
+	unsigned end = _midiMessageNext;
+	while (end < _midiMessageCount && _midiMessages[end].frame <= frame)
+		end++;
+	if (end > _midiMessageNext) {
+		_midiHandler->HandleMidiMessages(_midiMessages + _midiMessageNext, end - _midiMessageNext);
+		_midiMessageNext = end;
+	}
+	if (_midiMessageNext < _midiMessageCount && _midiMessages[_midiMessageNext].frame < num_frames)
+		return _midiMessages[_midiMessageNext].frame;
+	return num_frames;
+}
+
+// called in each thread JACK creates for us. JACK sets their priority, but they
+// can still be kept to the audio thread's CPUs
+void
+JackOutput::thread_init (void *arg)
+{
+	int err = Thread::getSchedule(kAudioThread).applyAffinity(pthread_self());
+	if (err)
+		std::cerr << "could not set JACK thread CPU affinity: " << strerror(err) << "\n";
+}
+
+// JACK calls the following from its notification thread, not the process thread
+
+int
+JackOutput::buffer_size_changed (jack_nframes_t nframes, void *arg)
+{
+	// nothing needs reallocating, the engine renders any number of frames with fixed scratch memory
+	JackOutput *self = (JackOutput *)arg;
+	self->config->buffer_size = nframes;
+	return 0;
+}
+
+int
+JackOutput::sample_rate_changed (jack_nframes_t nframes, void *arg)
+{
+	JackOutput *self = (JackOutput *)arg;
+	if (self->config->sample_rate != (int) nframes)
+		amsynth_set_sample_rate(nframes);
+	return 0;
+}
+
+int
+JackOutput::xrun (void *arg)
+{
+	JackOutput *self = (JackOutput *)arg;
+	__sync_add_and_fetch(&self->config->xruns, 1);
+	if (self->config->debug_drivers)
+		std::cerr << "JACK xrun, DSP load " << self->config->dsp_load << "%\n";
+	return 0;
+}
+
+void
+JackOutput::freewheel (int starting, void *arg)
+{
+	// when bouncing faster than realtime, the recording must keep every frame
+	JackOutput *self = (JackOutput *)arg;
+	self->mRecorder.setWaitForSpace(starting != 0);
+	amsynth_set_freewheel(starting);
+}
 #endif
 
 bool 
@@ -172,6 +262,7 @@ JackOutput::Stop()
 	jack_client_close(client);
 	client = 0;
 #endif
+	mRecorder.stop();
 }
 
 #ifdef HAVE_JACK_SESSION_H
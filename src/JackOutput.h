@@ -33,7 +33,9 @@
 #include "AudioOutput.h"
 #include "Config.h"
 
-class MidiStreamReceiver;
+#include "MidiDecoder.h"
+
+class MidiController;
 
 class JackOutput : public GenericOutput {
 
@@ -47,10 +49,17 @@ public:
 	
 	string		get_error_msg	( )		{ return error_msg; };
 	
-	void		setMidiHandler(MidiStreamReceiver *midiHandler) { _midiHandler = midiHandler; }
+	void		setMidiHandler(MidiController *midiHandler) { _midiHandler = midiHandler; }
+
+	unsigned	dispatchMidi	( unsigned frame, unsigned num_frames );
 
 #ifdef WITH_JACK
 	static int process(jack_nframes_t nframes, void *arg);
+	static int buffer_size_changed(jack_nframes_t nframes, void *arg);
+	static int sample_rate_changed(jack_nframes_t nframes, void *arg);
+	static int xrun(void *arg);
+	static void freewheel(int starting, void *arg);
+	static void thread_init(void *arg);
 #endif
 private:
 	string	error_msg;
@@ -59,7 +68,12 @@ private:
 	jack_port_t 	*l_port, *r_port, *m_port;
 	jack_client_t 	*client;
 #endif
-	MidiStreamReceiver *_midiHandler;
+	MidiController *_midiHandler;
+	MidiDecoder _midiDecoder;
+	// the current cycle's MIDI input, in frame order, see dispatchMidi()
+	MidiMessage _midiMessages[1024];
+	unsigned _midiMessageCount;
+	unsigned _midiMessageNext;
 };
 
 #endif				// _JACK_OUTPUT_H
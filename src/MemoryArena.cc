@@ -0,0 +1,104 @@
+/*
+ *  MemoryArena.cc
+ *
+ *  Copyright (c) 2001-2012 Nick Dowell
+ *
+ *  This file is part of amsynth.
+ *
+ *  amsynth is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  amsynth is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with amsynth.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MemoryArena.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+static const size_t kHugePageSize = 2 * 1024 * 1024;
+
+MemoryArena::MemoryArena()
+:	mMemory (NULL)
+,	mSize (0)
+,	mMappedSize (0)
+,	mUsed (0)
+,	mLocked (false)
+,	mHugePages (false)
+{
+}
+
+MemoryArena::~MemoryArena()
+{
+	if (mMemory)
+		munmap (mMemory, mMappedSize);
+}
+
+bool
+MemoryArena::allocate(size_t size, bool hugePages)
+{
+	const size_t pageSize = sysconf (_SC_PAGESIZE);
+	void *memory = MAP_FAILED;
+	size_t mappedSize = 0;
+#ifdef MAP_HUGETLB
+	if (hugePages) {
+		mappedSize = (size + kHugePageSize - 1) & ~(kHugePageSize - 1);
+		memory = mmap (NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	}
+#endif
+	mHugePages = memory != MAP_FAILED;
+	if (memory == MAP_FAILED) {
+		mappedSize = (size + pageSize - 1) & ~(pageSize - 1);
+		memory = mmap (NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	}
+	if (memory == MAP_FAILED)
+		return false;
+#ifdef MADV_HUGEPAGE
+	if (!mHugePages && hugePages)
+		madvise (memory, mappedSize, MADV_HUGEPAGE); // transparent huge pages, if enabled
+#endif
+
+	if (mMemory)
+		munmap (mMemory, mMappedSize);
+	mMemory = (char *) memory;
+	mSize = size;
+	mMappedSize = mappedSize;
+	mUsed = 0;
+	mLocked = false;
+
+	// fault every page in now, rather than on the audio thread
+	for (size_t offset = 0; offset < mMappedSize; offset += pageSize)
+		mMemory[offset] = 0;
+	return true;
+}
+
+bool
+MemoryArena::lock()
+{
+	if (mMemory && !mLocked)
+		mLocked = mlock (mMemory, mMappedSize) == 0;
+	return mLocked;
+}
+
+void *
+MemoryArena::take(size_t size)
+{
+	size = roundUp (size);
+	if (!mMemory || mUsed + size > mSize)
+		return NULL;
+	void *p = mMemory + mUsed;
+	mUsed += size;
+	return p;
+}
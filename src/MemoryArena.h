@@ -0,0 +1,74 @@
+/*
+ *  MemoryArena.h
+ *
+ *  Copyright (c) 2001-2012 Nick Dowell
+ *
+ *  This file is part of amsynth.
+ *
+ *  amsynth is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  amsynth is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with amsynth.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _MEMORY_ARENA_H
+#define _MEMORY_ARENA_H
+
+#include <new>
+#include <stddef.h>
+
+/**
+ * One block of memory holding objects which are used together by the audio
+ * thread, each starting on its own cache line. The memory is touched as soon
+ * as it is allocated, so that the audio thread never takes a page fault in it.
+ */
+class MemoryArena
+{
+public:
+	enum { kAlignment = 64 };
+
+	MemoryArena		();
+	~MemoryArena	();
+
+	// hugePages asks for the memory to come from the system's reserved huge
+	// pages, falling back to normal pages if there are none.
+	bool	allocate	(size_t size, bool hugePages = false);
+
+	// locks the memory into RAM. fails if RLIMIT_MEMLOCK is too low
+	bool	lock		();
+	bool	isLocked	() const { return mLocked; }
+	bool	isHugePages	() const { return mHugePages; }
+
+	// the next size bytes, or NULL if the arena is full
+	void *	take		(size_t size);
+
+	// objects made with create() must be destroyed with destroy()
+	template <class T> T *	create	() { void *p = take (sizeof(T)); return p ? new (p) T : NULL; }
+	template <class T> static void	destroy	(T *object) { if (object) object->~T(); }
+
+	// the number of bytes needed for an object of type T
+	template <class T> static size_t	sizeFor	(size_t count = 1) { return roundUp (sizeof(T)) * count; }
+
+	static size_t	roundUp	(size_t size) { return (size + kAlignment - 1) & ~(size_t)(kAlignment - 1); }
+
+private:
+	MemoryArena (const MemoryArena &);
+	MemoryArena & operator = (const MemoryArena &);
+
+	char *	mMemory;
+	size_t	mSize;
+	size_t	mMappedSize;
+	size_t	mUsed;
+	bool	mLocked;
+	bool	mHugePages;
+};
+
+#endif
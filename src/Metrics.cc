@@ -0,0 +1,157 @@
+/*
+ *  Metrics.cc
+ *
+ *  Copyright (c) 2001-2012 Nick Dowell
+ *
+ *  This file is part of amsynth.
+ *
+ *  amsynth is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  amsynth is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with amsynth.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Metrics.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint32_t kMagic = 0x616d7374; // "amst"
+
+struct Segment
+{
+	uint32_t			magic;
+	uint32_t			version;
+	uint32_t			pid;
+	volatile uint32_t	sequence;	// odd while the snapshot is being written
+	MetricsSnapshot		snapshot;
+};
+
+MetricsExport::MetricsExport()
+:	mSegment (0)
+{
+	mName[0] = '\0';
+}
+
+MetricsExport::~MetricsExport()
+{
+	if (!mSegment)
+		return;
+	munmap (mSegment, sizeof(Segment));
+	shm_unlink (mName);
+}
+
+bool
+MetricsExport::open()
+{
+	if (mSegment)
+		return true;
+	snprintf (mName, sizeof(mName), "/amsynth-%d", (int) getpid ());
+	int fd = shm_open (mName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+		return false;
+	void *memory = MAP_FAILED;
+	if (ftruncate (fd, sizeof(Segment)) == 0)
+		memory = mmap (NULL, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close (fd);
+	if (memory == MAP_FAILED) {
+		shm_unlink (mName);
+		return false;
+	}
+	mSegment = (Segment *) memory;
+	mSegment->version = METRICS_VERSION;
+	mSegment->pid = getpid ();
+	mSegment->sequence = 0;
+	__sync_synchronize ();
+	mSegment->magic = kMagic;
+	return true;
+}
+
+void
+MetricsExport::publish(const MetricsSnapshot &snapshot)
+{
+	if (!mSegment)
+		return;
+	const uint32_t sequence = mSegment->sequence;
+	mSegment->sequence = sequence + 1;
+	__sync_synchronize ();
+	memcpy (&mSegment->snapshot, &snapshot, sizeof(snapshot));
+	__sync_synchronize ();
+	mSegment->sequence = sequence + 2;
+}
+
+MetricsReader::MetricsReader()
+:	mSegment (0)
+{
+}
+
+MetricsReader::~MetricsReader()
+{
+	close ();
+}
+
+bool
+MetricsReader::open(const char *name)
+{
+	close ();
+	int fd = shm_open (name, O_RDONLY, 0);
+	if (fd == -1)
+		return false;
+	struct stat st;
+	void *memory = MAP_FAILED;
+	if (fstat (fd, &st) == 0 && st.st_size >= (off_t) sizeof(Segment))
+		memory = mmap (NULL, sizeof(Segment), PROT_READ, MAP_SHARED, fd, 0);
+	::close (fd);
+	if (memory == MAP_FAILED)
+		return false;
+	mSegment = (const Segment *) memory;
+	if (mSegment->magic != kMagic || mSegment->version != METRICS_VERSION) {
+		close ();
+		return false;
+	}
+	return true;
+}
+
+void
+MetricsReader::close()
+{
+	if (mSegment)
+		munmap ((void *) mSegment, sizeof(Segment));
+	mSegment = 0;
+}
+
+bool
+MetricsReader::read(MetricsSnapshot &snapshot) const
+{
+	if (!mSegment)
+		return false;
+	for (int tries = 0; tries < 1000; tries++) {
+		const uint32_t sequence = mSegment->sequence;
+		if (sequence & 1)
+			continue;
+		__sync_synchronize ();
+		memcpy (&snapshot, (const void *) &mSegment->snapshot, sizeof(snapshot));
+		__sync_synchronize ();
+		if (mSegment->sequence == sequence)
+			return true;
+	}
+	return false;
+}
+
+uint32_t
+MetricsReader::pid() const
+{
+	return mSegment ? mSegment->pid : 0;
+}
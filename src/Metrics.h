@@ -0,0 +1,116 @@
+/*
+ *  Metrics.h
+ *
+ *  Copyright (c) 2001-2012 Nick Dowell
+ *
+ *  This file is part of amsynth.
+ *
+ *  amsynth is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  amsynth is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with amsynth.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <stdint.h>
+
+#define METRICS_VERSION 1
+
+enum MetricsStage {
+	kMetricsStageVoices,	// parameter smoothing and the voices
+	kMetricsStageEffects,	// distortion, reverb and limiter
+	kMetricsStageCount
+};
+
+enum {
+	kMetricsStageTimes		= 1 << 0,	// render_ns is being measured
+	kMetricsDenormalCount	= 1 << 1,	// denormal_blocks is being counted (debug builds)
+};
+
+/**
+ * A running instance's statistics. The counters only increase, so rates are
+ * worked out by the reader from two snapshots.
+ */
+struct MetricsSnapshot
+{
+	uint64_t	time;				// microseconds, CLOCK_MONOTONIC
+	uint32_t	flags;
+	uint32_t	sample_rate;
+	uint32_t	active_voices;
+	uint32_t	max_voices;			// lowered by the polyphony governor
+	uint64_t	voices_stolen;		// for new notes, or by the governor
+	uint64_t	frames;				// rendered so far
+	uint64_t	render_ns[kMetricsStageCount];
+	uint64_t	xruns;
+	uint64_t	midi_events;
+	uint64_t	parameter_changes;
+	uint64_t	denormal_blocks;	// audio callbacks which flushed denormals
+	float		driver_dsp_load;	// percent, if the audio driver reports it
+	uint32_t	reserved;
+};
+
+/**
+ * Publishes a MetricsSnapshot in a POSIX shared memory segment named
+ * /amsynth-<pid>, which is removed again on destruction. publish() is
+ * wait-free, a reader copies the snapshot and retries if it changed
+ * meanwhile (a seqlock).
+ */
+class MetricsExport
+{
+public:
+	MetricsExport	();
+	~MetricsExport	();
+
+	bool	open	();
+	bool	isOpen	() const { return mSegment != 0; }
+
+	// only one thread may publish
+	void	publish	(const MetricsSnapshot &);
+
+	const char *	name	() const { return mName; }
+
+private:
+	MetricsExport (const MetricsExport &);
+	MetricsExport & operator = (const MetricsExport &);
+
+	struct Segment *mSegment;
+	char	mName[32];
+};
+
+/**
+ * Reads the segment of another process, see amsynth-stat.
+ */
+class MetricsReader
+{
+public:
+	MetricsReader	();
+	~MetricsReader	();
+
+	// name as given by MetricsExport::name(), e.g. "/amsynth-1234"
+	bool	open	(const char *name);
+	void	close	();
+
+	// false if the segment isn't open, or the writer kept it busy
+	bool	read	(MetricsSnapshot &) const;
+
+	// the process id of the writer
+	uint32_t	pid	() const;
+
+private:
+	MetricsReader (const MetricsReader &);
+	MetricsReader & operator = (const MetricsReader &);
+
+	const struct Segment *mSegment;
+};
+
+#endif
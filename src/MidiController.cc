@@ -31,15 +31,16 @@
 using namespace std;
 
 MidiController::MidiController( Config & config )
-:	last_active_controller ("last_active_cc", (Param) -1, 0, 0, MAX_CC, 1)
+:	last_active_controller (0)
+,	last_active_controller_listener (NULL)
 ,	_handler(NULL)
 ,	_rpn_msb(0xff)
 ,	_rpn_lsb(0xff)
 ,	_config_needs_save(false)
+,	_message_count(0)
 {
 	this->config = &config;
 	presetController = 0;
-	channel = config.midi_channel;
 	for( int i=0; i<MAX_CC; i++ ) midi_controllers[i] = 0;
 }
 
@@ -84,95 +85,101 @@ MidiController::setPresetController(PresetController & pc)
 void
 MidiController::HandleMidiData(const unsigned char* bytes, unsigned numBytes)
 {
-    for (unsigned i=0; i<numBytes; i++)
-	{
-		const unsigned char byte = bytes[i];
-		
-		if (byte & 0x80) {	// then byte is a status byte
-			if (byte < 0xf0) {	// dont deal with system messages
-			status = byte;
-			channel = (byte & 0x0f);
-			data = 0xff;
-			}
-			continue;
+	MidiMessage messages[64];
+	unsigned count = 0;
+	for (unsigned i=0; i<numBytes; i++) {
+		if (decoder.decode(bytes[i], messages[count]) && ++count == sizeof(messages) / sizeof(messages[0])) {
+			HandleMidiMessages(messages, count);
+			count = 0;
 		}
-		// now we have at least one data byte
+	}
+	HandleMidiMessages(messages, count);
+}
+
+// controllers mapped to parameters, rather than handled by controller_change() itself
+static bool
+is_parameter_controller(unsigned char cc)
+{
+	switch (cc) {
+		case MIDI_CC_BANK_SELECT_LSB:
+		case MIDI_CC_BANK_SELECT_MSB:
+		case MIDI_CC_SUSTAIN_PEDAL:
+		case MIDI_CC_DATA_ENTRY_MSB:
+		case MIDI_CC_PORTAMENTO:
+		case MIDI_CC_SOSTENUTO:
+		case MIDI_CC_NRPN_LSB:
+		case MIDI_CC_NRPN_MSB:
+		case MIDI_CC_RPN_LSB:
+		case MIDI_CC_RPN_MSB:
+			return false;
+		default:
+			return cc < MIDI_CC_ALL_SOUND_OFF;
+	}
+}
+
+void
+MidiController::HandleMidiMessages(const MidiMessage *messages, unsigned count)
+{
+	const int channel = config->midi_channel;
+
+	_message_count += count;
+
+	// a parameter only needs the last of several values sent to its controller in one batch
+	unsigned last_change[MAX_CC];
+	if (count > 1) {
+		for (unsigned i=0; i<MAX_CC; i++)
+			last_change[i] = count;
+		for (unsigned i=0; i<count; i++)
+			if (messages[i].type() == MIDI_STATUS_CONTROLLER && messages[i].data1 < MAX_CC &&
+				(!channel || (int) messages[i].channel() == channel - 1))
+				last_change[messages[i].data1] = i;
+	}
+
+	for (unsigned i=0; i<count; i++)
+	{
+		const MidiMessage &message = messages[i];
 
-		if (config->midi_channel && ((int) channel != config->midi_channel-1)) break;
+		if (channel && (int) message.channel() != channel - 1)
+			continue;
 
-		switch (status & 0xf0)
+		switch (message.type())
 		{
 		case MIDI_STATUS_NOTE_OFF:
-			// N.B. many devices send a 'note on' event with 0 velocity
-			// rather than a distinct 'note off' event.
-			if (data == 0xff) {
-				data = byte;
-				break;
-			}
-			dispatch_note( channel, data, 0 );
-			data = 0xff;
+			dispatch_note(message.channel(), message.data1, 0);
 			break;
 	
 		case MIDI_STATUS_NOTE_ON:
-			if (data == 0xff) {
-				data = byte;
-				break;
-			}
-			dispatch_note(channel, data, byte);
-			data = 0xff;
-			break;
-	
-		case MIDI_STATUS_NOTE_PRESSURE:
-			if (data == 0xff) {
-				data = byte;
-				break;
-			}
-			data = 0xff;
+			// N.B. many devices send a 'note on' event with 0 velocity
+			// rather than a distinct 'note off' event.
+			dispatch_note(message.channel(), message.data1, message.data2);
 			break;
 
 		case MIDI_STATUS_CONTROLLER:
-			if (data == 0xFF) {
-				data = byte;
+			if (count > 1 && is_parameter_controller(message.data1) && last_change[message.data1] != i)
 				break;
-			}
-			controller_change(data, byte);
-			data = 0xFF;
+			controller_change(message.data1, message.data2);
 			break;
 
 		case MIDI_STATUS_PROGRAM_CHANGE:
-			if (presetController->getCurrPresetNumber() != byte) {
-				if (_handler) _handler->HandleMidiAllSoundOff();
-				presetController->selectPreset((int) byte);
-			}
-			data = 0xff;
-			break;
-	
-		case MIDI_STATUS_CHANNEL_PRESSURE:
-			data = 0xff;
+			// sounding notes are released quickly by the VoiceAllocationUnit, see EndPresetChange()
+			if (presetController->getCurrPresetNumber() != message.data1)
+				presetController->selectPreset((int) message.data1);
 			break;
 	
 		case MIDI_STATUS_PITCH_WHEEL:
-			// 2 data bytes give a 14 bit value, least significant 7 bits
-			// first
-			if (data == 0xFF) {
-				data = byte;
-				break;
+			// 2 data bytes give a 14 bit value, least significant 7 bits first
+			{
+				const int bend = (int) (message.data1 | (message.data2 << 7));
+				pitch_wheel_change((float) (bend - 0x2000) / (float) (0x2000));
 			}
-			int bend; bend = (int) ((data & 0x7F) | ((byte & 0x7F) << 7));
-			float fbend; fbend = (float) (bend - 0x2000) / (float) (0x2000);
-			pitch_wheel_change(fbend);
-			data = 0xFF;
 			break;
-	
+
+		case MIDI_STATUS_NOTE_PRESSURE:
+		case MIDI_STATUS_CHANNEL_PRESSURE:
 		default:
-#ifdef _DEBUG
-			cout << "<MidiController> unknown status :" << hex <<
-			(int) status << "for data byte: " << hex << (int) byte <<
-			endl;
-#endif
 			break;
 		}
-    }
+	}
 }
 
 void
@@ -234,8 +241,10 @@ MidiController::controller_change(unsigned char cc, unsigned char value)
 			_handler->HandleMidiAllNotesOff();
 		case MIDI_CC_MODULATION_WHEEL:
 		default:
-			if (last_active_controller.getValue() != cc) {
-				last_active_controller.setValue(cc);
+			if (last_active_controller != cc) {
+				last_active_controller = cc;
+				if (last_active_controller_listener)
+					last_active_controller_listener->update();
 			}
 			getController(cc).SetNormalisedValue(value / 127.0f);
 			break;
@@ -22,6 +22,7 @@
 #ifndef _MIDICONTROLLER_H
 #define _MIDICONTROLLER_H
 
+#include "MidiDecoder.h"
 #include "PresetController.h"
 #include "drivers/MidiInterface.h"
 #include "Parameter.h"
@@ -56,16 +57,25 @@ public:
 	void	setPresetController	(PresetController & pc);
 	void	SetMidiEventHandler(MidiEventHandler* h) { _handler = h; }
 	
+	// decodes a raw MIDI stream, running status and partial messages carry over between calls
 	virtual void HandleMidiData(const unsigned char* bytes, unsigned numBytes);
+	// Applies a batch of messages in order. When a parameter's controller changes more than
+	// once in the batch only the last value is applied. Frame offsets are not used here,
+	// hosts wanting them split their blocks and pass each part's messages separately.
+	void	HandleMidiMessages(const MidiMessage *messages, unsigned count);
+	// the number of messages received, on any channel
+	unsigned long	getMessageCount	() const { return _message_count; }
 
 	void	saveConfig ();
 
 	void	setController		( unsigned int controller_no, Parameter &param );
 	int     getControllerForParam(unsigned paramIdx);
-	Parameter & getLastControllerParam() { return last_active_controller; };
+	// the last controller which changed, listener (eg. the MIDI learn dialog) is update()d when it changes
+	int		getLastActiveController	() { return last_active_controller; }
+	void	setLastActiveControllerListener	(UpdateListener *listener) { last_active_controller_listener = listener; }
 	Parameter & getController( unsigned int controller_no );
 	
-	int		get_midi_channel	() { return channel; }
+	int		get_midi_channel	() { return config->midi_channel; }
 	void	set_midi_channel	( int ch );
 	
 	int     sendMidi_values		();
@@ -80,12 +90,14 @@ private:
 
     PresetController *presetController;
 	Config *config;
-    unsigned char status, data, channel;
-	Parameter last_active_controller;
+	MidiDecoder decoder;
+	int last_active_controller;
+	UpdateListener *last_active_controller_listener;
 	Parameter *midi_controllers[MAX_CC];
 	MidiEventHandler* _handler;
 	unsigned char _rpn_msb, _rpn_lsb;
 
 	bool _config_needs_save;
+	unsigned long _message_count;
 };
 #endif
@@ -0,0 +1,56 @@
+/*
+ *  MidiDecoder.cc
+ *
+ *  Copyright (c) 2001-2012 Nick Dowell
+ *
+ *  This file is part of amsynth.
+ *
+ *  amsynth is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  amsynth is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with amsynth.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MidiDecoder.h"
+
+#include "midi.h"
+
+bool
+MidiDecoder::decode(unsigned char byte, MidiMessage &message)
+{
+	if (byte >= 0xf8) // system realtime, doesn't affect running status
+		return false;
+
+	if (byte & 0x80) {
+		// system common and exclusive messages cancel running status
+		mStatus = (byte < 0xf0) ? byte : 0;
+		mHaveData1 = false;
+		return false;
+	}
+
+	if (!mStatus) // data of a system message, or no status received yet
+		return false;
+
+	const unsigned char type = mStatus & 0xf0;
+	const bool two_data_bytes = (type != MIDI_STATUS_PROGRAM_CHANGE && type != MIDI_STATUS_CHANNEL_PRESSURE);
+	if (two_data_bytes && !mHaveData1) {
+		mData1 = byte;
+		mHaveData1 = true;
+		return false;
+	}
+
+	message.frame = 0;
+	message.status = mStatus;
+	message.data1 = two_data_bytes ? mData1 : byte;
+	message.data2 = two_data_bytes ? byte : 0;
+	mHaveData1 = false;
+	return true;
+}
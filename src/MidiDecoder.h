@@ -0,0 +1,61 @@
+/*
+ *  MidiDecoder.h
+ *
+ *  Copyright (c) 2001-2012 Nick Dowell
+ *
+ *  This file is part of amsynth.
+ *
+ *  amsynth is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  amsynth is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with amsynth.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _MIDI_DECODER_H
+#define _MIDI_DECODER_H
+
+/**
+ * A complete MIDI channel message.
+ */
+struct MidiMessage
+{
+	unsigned		frame;		// offset within the block the message belongs to
+	unsigned char	status;		// message type | channel
+	unsigned char	data1;
+	unsigned char	data2;		// 0 for messages with a single data byte
+
+	unsigned char	type	() const { return status & 0xf0; }
+	unsigned char	channel	() const { return status & 0x0f; }
+};
+
+/**
+ * Assembles channel messages from a raw MIDI byte stream, one byte at a time,
+ * so messages may be split across buffers. Handles running status, and skips
+ * system exclusive data and system messages, including realtime messages
+ * arriving in the middle of another message.
+ */
+class MidiDecoder
+{
+public:
+	MidiDecoder() { reset(); }
+
+	void	reset	() { mStatus = 0; mHaveData1 = false; }
+
+	// returns true if byte completes a channel message, which is written to message
+	bool	decode	(unsigned char byte, MidiMessage &message);
+
+private:
+	unsigned char	mStatus;	// the running status, 0 if none
+	unsigned char	mData1;
+	bool			mHaveData1;
+};
+
+#endif
@@ -21,71 +21,254 @@
 
 #include "Parameter.h"
 
+#include "Preset.h"
+#include "VoiceBoard/LowPassFilter.h"
+
 #include <algorithm>
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+
+const char *osc_waveform_names[] = {
+	"sine", "square / pulse", "saw / triangle", "white noise", "noise + sample & hold", NULL
+};
+
+const char *lfo_waveform_names[] = {
+	"sine", "square", "triangle", "noise", "noise + sample & hold", "sawtooth (up)", "sawtooth (down)", NULL
+};
+
+const char *keyboard_mode_names[] = {
+	"poly", "mono", "legato", NULL
+};
+
+const char *filter_type_names[] = {
+	"low pass", "high pass", "band pass", NULL
+};
+
+const char *filter_slope_names[] = {
+	"12 dB / octave", "24 dB / octave", NULL
+};
+
+#define TIME_PARAMETER(name, id) { name, id, 0, 0, 2.5f, 0, Parameter::PARAM_POWER, 3, 0.0005f, "s", NULL }
+
+// The one description of every parameter, in Param order.
+static const ParameterSpec kParameterSpecs[kAmsynthParameterCount] = {
+	//				name					id										def		min		max		inc		ControlType				base	offset	label	value strings
+	TIME_PARAMETER	("amp_attack",			kAmsynthParameter_AmpEnvAttack),
+	TIME_PARAMETER	("amp_decay",			kAmsynthParameter_AmpEnvDecay),
+	{				"amp_sustain",			kAmsynthParameter_AmpEnvSustain,		1,		0,		1,		0,		Parameter::PARAM_DIRECT,1,		0,		"",		NULL },
+	TIME_PARAMETER	("amp_release",			kAmsynthParameter_AmpEnvRelease),
+	{				"osc1_waveform",		kAmsynthParameter_Oscillator1Waveform,	2,		0,		4,		1,		Parameter::PARAM_DIRECT,1,		0,		"",		osc_waveform_names },
+	TIME_PARAMETER	("filter_attack",		kAmsynthParameter_FilterEnvAttack),
+	TIME_PARAMETER	("filter_decay",		kAmsynthParameter_FilterEnvDecay),
+	{				"filter_sustain",		kAmsynthParameter_FilterEnvSustain,		1,		0,		1,		0,		Parameter::PARAM_DIRECT,1,		0,		"",		NULL },
+	TIME_PARAMETER	("filter_release",		kAmsynthParameter_FilterEnvRelease),
+	{				"filter_resonance",		kAmsynthParameter_FilterResonance,		0,		0,		0.97f,	0,		Parameter::PARAM_DIRECT,1,		0,		"",		NULL },
+	{				"filter_env_amount",	kAmsynthParameter_FilterEnvAmount,		0,		-16,	16,		0,		Parameter::PARAM_DIRECT,1,		0,		"",		NULL },
+	{				"filter_cutoff",		kAmsynthParameter_FilterCutoff,			1.5,	-0.5,	1.5,	0,		Parameter::PARAM_EXP,	16,		0,		"",		NULL },
+	{				"osc2_detune",			kAmsynthParameter_Oscillator2Detune,	0,		-1,		1,		0,		Parameter::PARAM_EXP,	1.25f,	0,		"",		NULL },
+	{				"osc2_waveform",		kAmsynthParameter_Oscillator2Waveform,	2,		0,		4,		1,		Parameter::PARAM_DIRECT,1,		0,		"",		osc_waveform_names },
+	{				"master_vol",			kAmsynthParameter_MasterVolume,			0.67f,	0,		1,		0,		Parameter::PARAM_POWER,	2,		0,		"",		NULL },
+	{				"lfo_freq",				kAmsynthParameter_LFOFreq,				0,		0,		7.5,	0,		Parameter::PARAM_POWER,	2,		0,		"Hz",	NULL },
+	{				"lfo_waveform",			kAmsynthParameter_LFOWaveform,			0,		0,		6,		1,		Parameter::PARAM_DIRECT,1,		0,		"",		lfo_waveform_names },
+	{				"osc2_range",			kAmsynthParameter_Oscillator2Octave,	0,		-1,		2,		1,		Parameter::PARAM_EXP,	2,		0,		"",		NULL },
+	{				"osc_mix",				kAmsynthParameter_OscillatorMix,		0,		-1,		1,		0,		Parameter::PARAM_DIRECT,1,		0,		"",		NULL },
+	{				"freq_mod_amount",		kAmsynthParameter_LFOToOscillators,		0,		0,		1.25992105f,0,	Parameter::PARAM_POWER,	3,		-1,		"",		NULL },
+	{				"filter_mod_amount",	kAmsynthParameter_LFOToFilterCutoff,	-1,		-1,		1,		0,		Parameter::PARAM_DIRECT,1,		0,		"",		NULL },
+	{				"amp_mod_amount",		kAmsynthParameter_LFOToAmp,				-1,		-1,		1,		0,		Parameter::PARAM_DIRECT,1,		0,		"",		NULL },
+	{				"osc_mix_mode",			kAmsynthParameter_OscillatorMixRingMod,	0,		0,		1,		1,		Parameter::PARAM_DIRECT,1,		0,		"",		NULL },
+	{				"osc1_pulsewidth",		kAmsynthParameter_Oscillator1Pulsewidth,1,		0,		1,		0,		Parameter::PARAM_DIRECT,1,		0,		"",		NULL },
+	{				"osc2_pulsewidth",		kAmsynthParameter_Oscillator2Pulsewidth,1,		0,		1,		0,		Parameter::PARAM_DIRECT,1,		0,		"",		NULL },
+	{				"reverb_roomsize",		kAmsynthParameter_ReverbRoomsize,		0,		0,		1,		0,		Parameter::PARAM_DIRECT,1,		0,		"",		NULL },
+	{				"reverb_damp",			kAmsynthParameter_ReverbDamp,			0,		0,		1,		0,		Parameter::PARAM_DIRECT,1,		0,		"",		NULL },
+	{				"reverb_wet",			kAmsynthParameter_ReverbWet,			0,		0,		1,		0,		Parameter::PARAM_DIRECT,1,		0,		"",		NULL },
+	{				"reverb_width",			kAmsynthParameter_ReverbWidth,			1,		0,		1,		0,		Parameter::PARAM_DIRECT,1,		0,		"",		NULL },
+	{				"distortion_crunch",	kAmsynthParameter_AmpDistortion,		0,		0,		0.9f,	0,		Parameter::PARAM_DIRECT,1,		0,		"",		NULL },
+	{				"osc2_sync",			kAmsynthParameter_Oscillator2Sync,		0,		0,		1,		1,		Parameter::PARAM_DIRECT,1,		0,		"",		NULL },
+	{				"portamento_time",		kAmsynthParameter_PortamentoTime,		0,		0,		1,		0,		Parameter::PARAM_DIRECT,1,		0,		"",		NULL },
+	{				"keyboard_mode",		kAmsynthParameter_KeyboardMode,			KeyboardModePoly, 0, KeyboardModeLegato, 1, Parameter::PARAM_DIRECT, 1, 0,	"",		keyboard_mode_names },
+	{				"osc2_pitch",			kAmsynthParameter_Oscillator2Pitch,		0,		-12,	12,		1,		Parameter::PARAM_DIRECT,1,		0,		"",		NULL },
+	{				"filter_type",			kAmsynthParameter_FilterType,			SynthFilter::FilterTypeLowPass, SynthFilter::FilterTypeLowPass, SynthFilter::FilterTypeCount - 1, 1, Parameter::PARAM_DIRECT, 1, 0, "", filter_type_names },
+	{				"filter_slope",			kAmsynthParameter_FilterSlope,			SynthFilter::FilterSlope24, SynthFilter::FilterSlope12, SynthFilter::FilterSlope24, 1, Parameter::PARAM_DIRECT, 1, 0, "", filter_slope_names },
+};
+
+#undef TIME_PARAMETER
+
+static const ParameterSpec kNullParameterSpec =
+	{ "null", kAmsynthParameterCount, 0, 0, 1, 0, Parameter::PARAM_DIRECT, 1, 0, "", NULL };
 
-Parameter::Parameter	(std::string name, Param id, float value, float min, float max, float inc, ControlType type, float base, float offset, std::string label)
-:	mParamId	(id)
-,	_name		(name)
-,	_label		(label)
-,	_controlMode	(type)
-,	_value		(NAN)
-,	_min		(min)
-,	_max		(max)
-,	_step		(inc)
-,	_controlValue(NAN)
-,	_base		(base)
-,	_offset		(offset)
-,	_valueStrings(NULL)
+////////////////////////////////////////////////////////////////////////////////
+
+// Parameter names are looked up through a perfect hash of the names in
+// kParameterSpecs. The seed is searched for on first use, such that every
+// name hashes to its own slot; a lookup is then one hash and one strcmp().
+
+enum { kNameHashSize = 256 };
+
+static unsigned char s_name_hash_slots[kNameHashSize];	// parameter index, or 0xff if empty
+static unsigned s_name_hash_seed;
+static pthread_once_t s_name_hash_once = PTHREAD_ONCE_INIT;
+
+static inline unsigned name_hash(const char *name, unsigned seed)
 {
-	setValue (value);
+	unsigned hash = 2166136261u ^ seed; // FNV-1a
+	while (*name)
+		hash = (hash ^ (unsigned char)*name++) * 16777619u;
+	return hash ^ (hash >> 15);
 }
 
-void
-Parameter::addUpdateListener	(UpdateListener& ul)
+static void name_hash_init()
 {
-	for (unsigned i=0; i<_updateListeners.size(); i++) if (_updateListeners[i] == &ul) return;
-	_updateListeners.push_back (&ul);
-	_updateListeners.back()->UpdateParameter (mParamId, _controlValue);
+	for (unsigned seed = 1; ; seed++) {
+		memset(s_name_hash_slots, 0xff, sizeof(s_name_hash_slots));
+		bool collision = false;
+		for (int i = 0; i < kAmsynthParameterCount && !collision; i++) {
+			unsigned char &slot = s_name_hash_slots[name_hash(kParameterSpecs[i].name, seed) % kNameHashSize];
+			collision = (slot != 0xff);
+			slot = i;
+		}
+		if (!collision) {
+			s_name_hash_seed = seed;
+			return;
+		}
+	}
 }
 
-void
-Parameter::removeUpdateListener( UpdateListener & ul )
+/* this implements the parameter name part of the C API in controls.h */
+
+const char *parameter_name_from_index (int param_index)
 {
-	for (unsigned i=0; i<_updateListeners.size(); i++)
-		if (_updateListeners[i] == &ul) _updateListeners.erase(_updateListeners.begin()+i);
+	if (param_index < 0 || param_index >= kAmsynthParameterCount)
+		return NULL;
+	return kParameterSpecs[param_index].name;
 }
 
-void
-Parameter::setValue(float value)
+int parameter_index_from_name (const char *param_name)
 {
-	float newValue = std::min(std::max(value, _min), _max);
+	pthread_once (&s_name_hash_once, name_hash_init);
+	int index = s_name_hash_slots[name_hash(param_name, s_name_hash_seed) % kNameHashSize];
+	if (index == 0xff || strcmp(param_name, kParameterSpecs[index].name) != 0)
+		return -1;
+	return index;
+}
 
-	if (_step) {
-		newValue = _min + roundf((newValue - _min) / _step) * _step;
-		assert(::fmodf(newValue - _min, _step) == 0);
-	}
+Quality quality_from_name (const char *name)
+{
+	if (strcmp(name, "eco") == 0)
+		return QualityEco;
+	if (strcmp(name, "high") == 0)
+		return QualityHigh;
+	return QualityStandard;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+float
+ParameterSpec::constrain(float value) const
+{
+	float newValue = std::min(std::max(value, min), max);
 
-	if (_value == newValue) // warning: -ffast-math causes this comparison to fail
-		return;
-
-	_value = newValue;
-
-	switch (_controlMode) {
-		case PARAM_DIRECT:
-			_controlValue = _offset + _base * _value;
-			break;
-		case PARAM_EXP:
-			_controlValue = _offset + ::pow( (float)_base, _value );
-			break;
-		case PARAM_POWER:
-			_controlValue = _offset + ::pow( _value, (float)_base );
-			break;
+	if (inc) {
+		newValue = min + roundf((newValue - min) / inc) * inc;
+		assert(::fmodf(newValue - min, inc) == 0);
 	}
 
-	for (unsigned i=0; i<_updateListeners.size(); i++) {
-		_updateListeners[i]->UpdateParameter (mParamId, _controlValue);
+	if (newValue == 0) // no negative zeros, presets are compared with memcmp()
+		newValue = 0;
+
+	return newValue;
+}
+
+float
+ParameterSpec::controlValue(float value) const
+{
+	switch (type) {
+		case Parameter::PARAM_DIRECT:
+			return offset + base * value;
+		case Parameter::PARAM_EXP:
+			return offset + ::pow( (float)base, value );
+		case Parameter::PARAM_POWER:
+			return offset + ::pow( value, (float)base );
 	}
+	return value;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+const ParameterSpec &
+Parameter::getSpec(int id)
+{
+	return (0 <= id && id < kAmsynthParameterCount) ? kParameterSpecs[id] : kNullParameterSpec;
+}
+
+float
+Parameter::getValue() const
+{
+	return (mPreset && mParamId < kAmsynthParameterCount) ? mPreset->getValue(mParamId) : kNullParameterSpec.def;
+}
+
+void
+Parameter::setValue(float value)
+{
+	if (mPreset)
+		mPreset->setValue(mParamId, value);
+}
+
+float
+Parameter::getControlValue() const
+{
+	return getSpec(mParamId).controlValue(getValue());
+}
+
+const std::string
+Parameter::getName() const
+{
+	return getSpec(mParamId).name;
+}
+
+const std::string
+Parameter::getLabel() const
+{
+	return getSpec(mParamId).label;
+}
+
+float
+Parameter::getMin() const
+{
+	return getSpec(mParamId).min;
+}
+
+float
+Parameter::getMax() const
+{
+	return getSpec(mParamId).max;
+}
+
+float
+Parameter::getStep() const
+{
+	return getSpec(mParamId).inc;
+}
+
+const char **
+Parameter::valueStrings() const
+{
+	return getSpec(mParamId).value_strings;
+}
+
+void
+Parameter::addUpdateListener	(UpdateListener& ul)
+{
+	if (mPreset && mParamId < kAmsynthParameterCount)
+		mPreset->addListener (&ul, mParamId);
+}
+
+void
+Parameter::removeUpdateListener( UpdateListener & ul )
+{
+	if (mPreset && mParamId < kAmsynthParameterCount)
+		mPreset->removeListener (&ul, mParamId);
 }
 
 void
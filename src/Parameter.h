@@ -26,18 +26,24 @@
 #include <vector>
 #include <sstream>
 #include <cmath>
+#include "controls.h"
 #include "UpdateListener.h"
 
+class Preset;
+struct ParameterSpec;
+
 /**
- * @brief a Parameter holds a particular value for a slider, selector switch 
- * etc..
+ * @brief a Parameter gives access to one value of a Preset, eg for a slider,
+ * selector switch etc..
  *
- * This object is also responsible for keeping all audio/signal generation 
- * objects up to date with any controls which affect them.
+ * A Parameter does not hold any state itself. Its value lives in the float
+ * array of the Preset it belongs to, its name, range and scaling come from a
+ * static table shared by all presets (see getSpec()), and listeners are kept
+ * and notified by the Preset.
  *
- * This object also easily enables non-linear relationships between the controls
+ * Parameters also easily enable non-linear relationships between the controls
  * (eg interface ParameterViews) and their effect on synthesis parameters. See
- * setType() for details.
+ * ControlType for details.
  */
 
 class Parameter {
@@ -49,14 +55,12 @@ public:
 		PARAM_POWER		// controlValue = offset + value ^ base
 	};
 
-					Parameter		(const std::string name = "unused", Param id = kAmsynthParameterCount,
-									 float value = 0.0, float min = 0.0, float max = 1.0, float inc = 0.0,
-									 ControlType = PARAM_DIRECT, float base = 1.0, float offset = 0.0,
-									 const std::string label = "");
+	// the metadata for a parameter, kAmsynthParameterCount gives the "null" parameter
+	static const ParameterSpec &	getSpec	(int id);
 
 	// The raw value of this parameter. Objects in the signal generation 
 	// path should not use this method, but getControlValue() instead.
-	float			getValue		() const { return _value; }
+	float			getValue		() const;
 	void			setValue		(float value);
 
 	static float	valueFromString	(const std::string &str) {
@@ -75,11 +79,11 @@ public:
 
 	// The control value for this parameter.
 	// The control value is what the synthesis will use to get its values.
-	inline float	getControlValue	() const { return _controlValue; }
+	float			getControlValue	() const;
 
-	const std::string GetStringValue	() const { std::ostringstream o; o << _controlValue; return o.str(); }
+	const std::string GetStringValue	() const { std::ostringstream o; o << getControlValue(); return o.str(); }
 
-	const std::string getName			() const { return _name; }
+	const std::string getName			() const;
 	Param			GetId			() const { return mParamId; }
 
 	// UpdateListeners (eg one or more ParameterViews - part of the GUI) are 
@@ -88,30 +92,46 @@ public:
 	void			removeUpdateListener (UpdateListener& ul);
 	
 	// min/max values apply for calls to setValue() not ControlValue
-	float			getMin			() const { return _min; }
-	float			getMax			() const { return _max; }
+	float			getMin			() const;
+	float			getMax			() const;
 
 	// @return the increment value
-	float			getStep			() const { return _step; }
+	float			getStep			() const;
 	// @returns The number of discrete steps allowable in this Parameter.
-	int				getSteps		() const { return _step ? (_max - _min) / _step : 0; }
+	int				getSteps		() const { return getStep() ? (getMax() - getMin()) / getStep() : 0; }
 
 	// Set this parameter to a random value (in it's allowable range)
 	void			random_val		();
 
 	// The label assocaited with this Parameter. (e.g. "seconds")
-	const std::string getLabel		() const { return _label; }
+	const std::string getLabel		() const;
 
-	const char **   valueStrings    () const { return _valueStrings; }
-	void            setValueStrings (const char **valueStrings) { _valueStrings = valueStrings; }
+	const char **   valueStrings    () const;
 
 private:
-	Param							mParamId;
-	std::string						_name, _label;
-	int								_controlMode;
-	float							_value, _min, _max, _step, _controlValue, _base, _offset;
-	std::vector<UpdateListener*>	_updateListeners;
-	const char **					_valueStrings;
+	friend class Preset;
+					Parameter		() : mPreset (0), mParamId (kAmsynthParameterCount) {}
+
+	Preset *		mPreset;
+	Param			mParamId;
+};
+
+/**
+ * @brief the static description of a parameter
+ */
+struct ParameterSpec
+{
+	const char *			name;
+	Param					id;
+	float					def, min, max, inc;
+	Parameter::ControlType	type;
+	float					base, offset;
+	const char *			label;
+	const char **			value_strings;
+
+	// value clamped to min..max and rounded to a multiple of inc
+	float	constrain		(float value) const;
+	float	controlValue	(float value) const;
 };
 
 #endif
@@ -0,0 +1,144 @@
+/*
+ *  ParameterSmoother.cc
+ *
+ *  Copyright (c) 2001-2012 Nick Dowell
+ *
+ *  This file is part of amsynth.
+ *
+ *  amsynth is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  amsynth is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with amsynth.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ParameterSmoother.h"
+
+#include <string.h>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+static const float kRampTime = 0.02f; // seconds
+
+ParameterSmoother::ParameterSmoother()
+:	mPending (0)
+,	mMoving (0)
+{
+	memset (mValue, 0, sizeof(mValue));
+	memset (mStep, 0, sizeof(mStep));
+	memset (mRemaining, 0, sizeof(mRemaining));
+	memset (mEnd, 0, sizeof(mEnd));
+	for (unsigned i = 0; i < kSize; i++) {
+		mTarget[i] = 0;
+		mHasTarget[i] = false;
+		mHasValue[i] = false;
+	}
+	setSampleRate (44100);
+}
+
+void
+ParameterSmoother::setSampleRate	(int rate)
+{
+	mRampFrames = kRampTime * rate;
+}
+
+void
+ParameterSmoother::setTarget		(Param param, float value)
+{
+	mTarget[param] = value;
+	mHasTarget[param] = true;
+	__sync_synchronize(); // publish the target before the flag
+	mPending = 1;
+}
+
+void
+ParameterSmoother::reset			(Param param, float value)
+{
+	mTarget[param] = value;
+	mHasTarget[param] = true;
+	mHasValue[param] = true;
+	if (mRemaining[param] > 0)
+		mMoving--;
+	mValue[param] = mEnd[param] = value;
+	mStep[param] = 0;
+	mRemaining[param] = 0;
+}
+
+unsigned
+ParameterSmoother::beginRamps		(Param *changed)
+{
+	unsigned count = 0;
+	mPending = 0;
+	__sync_synchronize();
+	for (unsigned i = 0; i < kAmsynthParameterCount; i++) {
+		if (!mHasTarget[i])
+			continue;
+		const float target = mTarget[i];
+		if (!mHasValue[i]) {
+			mHasValue[i] = true;
+			mValue[i] = mEnd[i] = target;
+			changed[count++] = (Param) i;
+			continue;
+		}
+		if (target == mEnd[i])
+			continue;
+		// restart from wherever the parameter is now
+		if (mRemaining[i] == 0)
+			mMoving++;
+		mEnd[i] = target;
+		mStep[i] = (target - mValue[i]) / mRampFrames;
+		mRemaining[i] = mRampFrames;
+	}
+	return count;
+}
+
+unsigned
+ParameterSmoother::process		(unsigned frames, Param *changed)
+{
+	unsigned count = 0;
+	if (mPending)
+		count = beginRamps (changed);
+	if (!mMoving)
+		return count;
+
+	for (unsigned i = 0; i < kAmsynthParameterCount; i++)
+		if (mRemaining[i] > 0)
+			changed[count++] = (Param) i;
+
+	// every ramp advances at once; finished ones land exactly on their end
+	// value, and parameters which aren't moving have nothing remaining
+	const float n = (float) frames;
+	unsigned i = 0;
+#ifdef __SSE__
+	const __m128 vn = _mm_set1_ps (n), zero = _mm_setzero_ps ();
+	for (; i < kSize; i += 4) {
+		__m128 remaining = _mm_loadu_ps (mRemaining + i);
+		__m128 advance = _mm_min_ps (remaining, vn);
+		__m128 value = _mm_add_ps (_mm_loadu_ps (mValue + i), _mm_mul_ps (_mm_loadu_ps (mStep + i), advance));
+		remaining = _mm_sub_ps (remaining, advance);
+		__m128 done = _mm_cmple_ps (remaining, zero);
+		value = _mm_or_ps (_mm_and_ps (done, _mm_loadu_ps (mEnd + i)), _mm_andnot_ps (done, value));
+		_mm_storeu_ps (mValue + i, value);
+		_mm_storeu_ps (mRemaining + i, remaining);
+	}
+#endif
+	for (; i < kSize; i++) {
+		const float advance = mRemaining[i] < n ? mRemaining[i] : n;
+		mRemaining[i] -= advance;
+		mValue[i] = mRemaining[i] <= 0 ? mEnd[i] : mValue[i] + mStep[i] * advance;
+	}
+
+	mMoving = 0;
+	for (i = 0; i < kAmsynthParameterCount; i++)
+		mMoving += mRemaining[i] > 0;
+	return count;
+}
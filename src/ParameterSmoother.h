@@ -0,0 +1,72 @@
+/*
+ *  ParameterSmoother.h
+ *
+ *  Copyright (c) 2001-2012 Nick Dowell
+ *
+ *  This file is part of amsynth.
+ *
+ *  amsynth is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  amsynth is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with amsynth.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PARAMETER_SMOOTHER_H
+#define _PARAMETER_SMOOTHER_H
+
+#include "controls.h"
+
+/**
+ * Ramps continuous parameters towards new values over a few milliseconds so
+ * that MIDI CC and automation don't step the sound at block boundaries.
+ *
+ * Everything runs on the audio thread: VoiceAllocationUnit::UpdateParameter()
+ * queues values from other threads and hands them to setTarget() from
+ * Process(). process() costs nothing while no parameter is moving.
+ */
+class ParameterSmoother
+{
+public:
+	ParameterSmoother();
+
+	void	setSampleRate	(int rate);
+
+	// the first value given for a parameter is applied without a ramp
+	void	setTarget		(Param, float value);
+	// audio thread: moves straight to value, cancelling any ramp
+	void	reset			(Param, float value);
+
+	// Starts ramps towards any new targets and advances all moving parameters by
+	// frames. Parameters whose value changed are written to changed, and their
+	// count is returned.
+	unsigned	process		(unsigned frames, Param *changed);
+
+	float	getValue		(Param param) const { return mValue[param]; }
+
+private:
+	// padded to a multiple of four for the SSE code
+	static const unsigned kSize = (kAmsynthParameterCount + 3) & ~3;
+
+	unsigned	beginRamps	(Param *changed);
+
+	float			mValue[kSize];
+	float			mStep[kSize];
+	float			mRemaining[kSize];	// frames until the ramp ends
+	float			mEnd[kSize];
+	volatile float	mTarget[kSize];
+	bool			mHasTarget[kSize];
+	bool			mHasValue[kSize];
+	volatile int	mPending;
+	unsigned		mMoving;
+	float			mRampFrames;
+};
+
+#endif
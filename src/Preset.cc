@@ -22,131 +22,141 @@
 #include "Preset.h"
 
 #include "controls.h"
-#include "VoiceBoard/LowPassFilter.h"
 
+#include <cassert>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 
 #ifdef _DEBUG
 #include <iostream>
 using namespace std;
 #endif
 
-Parameter TimeParameter (const std::string name, Param id)
+Preset::Preset			(const std::string name)
+:	mName (name)
 {
-	return Parameter (name, id, 0, 0, 2.5f, 0, Parameter::PARAM_POWER, 3, 0.0005f, "s");
+	bindParameters();
+	for (int i = 0; i < kAmsynthParameterCount; i++) {
+		const ParameterSpec &spec = Parameter::getSpec(i);
+		assert (spec.id == i);
+		mValues[i] = spec.constrain(spec.def);
+	}
 }
 
-const char *osc_waveform_names[] = {
-	"sine", "square / pulse", "saw / triangle", "white noise", "noise + sample & hold", NULL
-};
-
-const char *lfo_waveform_names[] = {
-	"sine", "square", "triangle", "noise", "noise + sample & hold", "sawtooth (up)", "sawtooth (down)", NULL
-};
-
-const char *keyboard_mode_names[] = {
-	"poly", "mono", "legato", NULL
-};
-
-const char *filter_type_names[] = {
-	"low pass", "high pass", "band pass", NULL
-};
-
-const char *filter_slope_names[] = {
-	"12 dB / octave", "24 dB / octave", NULL
-};
-
-Preset::Preset			(const std::string name)
-:	mName (name)
-,	nullparam ("null", kAmsynthParameterCount)
+Preset::Preset			(const Preset &rhs)
+:	mName (rhs.mName)
 {
-	//										name					id					def min max inc		ControlType			base offset label
-	mParameters.push_back (TimeParameter	("amp_attack",			kAmsynthParameter_AmpEnvAttack));
-	mParameters.push_back (TimeParameter	("amp_decay",			kAmsynthParameter_AmpEnvDecay));
-    mParameters.push_back (Parameter		("amp_sustain",			kAmsynthParameter_AmpEnvSustain,		1));
-    mParameters.push_back (TimeParameter	("amp_release",			kAmsynthParameter_AmpEnvRelease));
-    mParameters.push_back (Parameter		("osc1_waveform",		kAmsynthParameter_Oscillator1Waveform,		2, 0, 4, 1));
-    mParameters.push_back (TimeParameter	("filter_attack",		kAmsynthParameter_FilterEnvAttack));
-    mParameters.push_back (TimeParameter	("filter_decay",		kAmsynthParameter_FilterEnvDecay));
-    mParameters.push_back (Parameter		("filter_sustain",		kAmsynthParameter_FilterEnvSustain,		1));
-    mParameters.push_back (TimeParameter	("filter_release",		kAmsynthParameter_FilterEnvRelease));
-    mParameters.push_back (Parameter		("filter_resonance",	kAmsynthParameter_FilterResonance,	0, 0, 0.97f));
-	mParameters.push_back (Parameter		("filter_env_amount",	kAmsynthParameter_FilterEnvAmount,	0, -16, 16));
-	mParameters.push_back (Parameter		("filter_cutoff",		kAmsynthParameter_FilterCutoff,		1.5, -0.5, 1.5, 0,	Parameter::PARAM_EXP, 16, 0));
-    mParameters.push_back (Parameter		("osc2_detune",			kAmsynthParameter_Oscillator2Detune,		0, -1, 1, 0,		Parameter::PARAM_EXP, 1.25f, 0));
-    mParameters.push_back (Parameter		("osc2_waveform",		kAmsynthParameter_Oscillator2Waveform,		2, 0, 4, 1));
-    mParameters.push_back (Parameter		("master_vol",			kAmsynthParameter_MasterVolume,			0.67, 0, 1, 0,		Parameter::PARAM_POWER, 2, 0));
-    mParameters.push_back (Parameter		("lfo_freq",			kAmsynthParameter_LFOFreq,			0, 0, 7.5, 0,		Parameter::PARAM_POWER, 2, 0,	"Hz"));
-    mParameters.push_back (Parameter		("lfo_waveform",		kAmsynthParameter_LFOWaveform,		0, 0, 6, 1));
-    mParameters.push_back (Parameter		("osc2_range",			kAmsynthParameter_Oscillator2Octave,		0, -1, 2, 1,		Parameter::PARAM_EXP, 2, 0));
-	mParameters.push_back (Parameter		("osc_mix",				kAmsynthParameter_OscillatorMix,			0, -1, 1));
-	mParameters.push_back (Parameter		("freq_mod_amount",		kAmsynthParameter_LFOToOscillators,		0, 0, 1.25992105f,0,Parameter::PARAM_POWER, 3, -1));
-	mParameters.push_back (Parameter		("filter_mod_amount",	kAmsynthParameter_LFOToFilterCutoff,	-1, -1, 1));
-	mParameters.push_back (Parameter		("amp_mod_amount",		kAmsynthParameter_LFOToAmp,		-1, -1, 1));
-	mParameters.push_back (Parameter		("osc_mix_mode",		kAmsynthParameter_OscillatorMixRingMod,		0, 0, 1, 1));
-	mParameters.push_back (Parameter		("osc1_pulsewidth",		kAmsynthParameter_Oscillator1Pulsewidth,	1));
-	mParameters.push_back (Parameter		("osc2_pulsewidth",		kAmsynthParameter_Oscillator2Pulsewidth,	1));
-	mParameters.push_back (Parameter		("reverb_roomsize",		kAmsynthParameter_ReverbRoomsize));
-	mParameters.push_back (Parameter		("reverb_damp",			kAmsynthParameter_ReverbDamp));
-	mParameters.push_back (Parameter		("reverb_wet",			kAmsynthParameter_ReverbWet));
-	mParameters.push_back (Parameter		("reverb_width",		kAmsynthParameter_ReverbWidth,		1));
-	mParameters.push_back (Parameter		("distortion_crunch",	kAmsynthParameter_AmpDistortion,	0, 0, 0.9f));
-	mParameters.push_back (Parameter		("osc2_sync",			kAmsynthParameter_Oscillator2Sync,			0, 0, 1, 1));
-	mParameters.push_back (Parameter		("portamento_time",		kAmsynthParameter_PortamentoTime, 0.0f, 0.0f, 1.0f));
-	mParameters.push_back (Parameter		("keyboard_mode",		kAmsynthParameter_KeyboardMode, KeyboardModePoly, 0, KeyboardModeLegato, 1));
-	mParameters.push_back (Parameter		("osc2_pitch",			kAmsynthParameter_Oscillator2Pitch, 0, -12, +12, 1));
-	mParameters.push_back (Parameter		("filter_type",         kAmsynthParameter_FilterType, SynthFilter::FilterTypeLowPass, SynthFilter::FilterTypeLowPass, SynthFilter::FilterTypeCount - 1, 1));
-	mParameters.push_back (Parameter		("filter_slope",        kAmsynthParameter_FilterSlope, SynthFilter::FilterSlope24, SynthFilter::FilterSlope12, SynthFilter::FilterSlope24, 1));
+	bindParameters();
+	memcpy(mValues, rhs.mValues, sizeof(mValues));
+}
 
-	getParameter(kAmsynthParameter_Oscillator1Waveform).setValueStrings(osc_waveform_names);
-	getParameter(kAmsynthParameter_Oscillator2Waveform).setValueStrings(osc_waveform_names);
-	getParameter(kAmsynthParameter_LFOWaveform).setValueStrings(lfo_waveform_names);
-	getParameter(kAmsynthParameter_KeyboardMode).setValueStrings(keyboard_mode_names);
-	getParameter(kAmsynthParameter_FilterType).setValueStrings(filter_type_names);
-	getParameter(kAmsynthParameter_FilterSlope).setValueStrings(filter_slope_names);
+Preset::~Preset			()
+{
 }
 
 Preset&
 Preset::operator =		(const Preset &rhs)
 {
-    for (unsigned i=0; i<rhs.ParameterCount(); i++) {
-		getParameter(i).setValue(rhs.getParameter(i).getValue());
-    }
-    setName(rhs.getName());
-    return *this;
+	if (mListeners.empty()) {
+		memcpy(mValues, rhs.mValues, sizeof(mValues));
+	} else {
+		for (unsigned i = 0; i < mListeners.size(); i++)
+			if (mListeners[i].param == kAmsynthParameterCount)
+				mListeners[i].listener->BeginPresetChange();
+		for (int i = 0; i < kAmsynthParameterCount; i++) {
+			if (mValues[i] != rhs.mValues[i]) {
+				mValues[i] = rhs.mValues[i];
+				notify(i);
+			}
+		}
+		for (unsigned i = 0; i < mListeners.size(); i++)
+			if (mListeners[i].param == kAmsynthParameterCount)
+				mListeners[i].listener->EndPresetChange();
+	}
+	setName(rhs.getName());
+	return *this;
 }
 
 bool
 Preset::isEqual(const Preset &rhs)
 {
-	for (unsigned i = 0; i < mParameters.size(); i++) {
-		if (getParameter(i).getValue() != rhs.getParameter(i).getValue()) {
-			return false;
-		}
+	return memcmp(mValues, rhs.mValues, sizeof(mValues)) == 0 && getName() == rhs.getName();
+}
+
+void
+Preset::setValue(int no, float value)
+{
+	if (no < 0 || no >= kAmsynthParameterCount)
+		return;
+	const float newValue = Parameter::getSpec(no).constrain(value);
+	if (mValues[no] == newValue) // warning: -ffast-math causes this comparison to fail
+		return;
+	mValues[no] = newValue;
+	notify(no);
+}
+
+void
+Preset::notify(int no)
+{
+	const float controlValue = Parameter::getSpec(no).controlValue(mValues[no]);
+	for (unsigned i = 0; i < mListeners.size(); i++) {
+		if (mListeners[i].param == no || mListeners[i].param == kAmsynthParameterCount)
+			mListeners[i].listener->UpdateParameter ((Param) no, controlValue);
+	}
+}
+
+void
+Preset::bindParameters()
+{
+	for (int i = 0; i < kAmsynthParameterCount; i++) {
+		mParameters[i].mPreset = this;
+		mParameters[i].mParamId = (Param) i;
 	}
-	return getName() == rhs.getName();
 }
 
 Parameter & 
-Preset::getParameter(const std::string name)
+Preset::getParameter(const char *name)
 {
-    for (unsigned i = 0; i < mParameters.size(); i++) if (getParameter(i).getName() == name) return mParameters[i];
-    return nullparam;
+	int index = parameter_index_from_name (name);
+	return mParameters[(index != -1) ? index : kAmsynthParameterCount];
 }
 
 void
 Preset::randomise()
 {
-	float master_vol = getParameter("master_vol").getValue ();
-	for (unsigned i=0; i<mParameters.size(); i++) getParameter(i).random_val();
-	getParameter("master_vol").setValue (master_vol);
+	float master_vol = getValue (kAmsynthParameter_MasterVolume);
+	for (int i = 0; i < kAmsynthParameterCount; i++) {
+		const ParameterSpec &spec = Parameter::getSpec(i);
+		setValue (i, (rand()/(float)RAND_MAX) * (spec.max - spec.min) + spec.min);
+	}
+	setValue (kAmsynthParameter_MasterVolume, master_vol);
+}
+
+void
+Preset::addListener		(UpdateListener *ul, Param param)
+{
+	for (unsigned i = 0; i < mListeners.size(); i++)
+		if (mListeners[i].listener == ul && mListeners[i].param == param) return;
+	Listener listener = { ul, param };
+	mListeners.push_back (listener);
+	for (int i = 0; i < kAmsynthParameterCount; i++)
+		if (i == param || param == kAmsynthParameterCount)
+			ul->UpdateParameter ((Param) i, Parameter::getSpec(i).controlValue(mValues[i]));
+}
+
+void
+Preset::removeListener	(UpdateListener *ul, Param param)
+{
+	for (unsigned i = 0; i < mListeners.size(); i++)
+		if (mListeners[i].listener == ul && mListeners[i].param == param)
+			mListeners.erase (mListeners.begin() + i--);
 }
 
 void
 Preset::AddListenerToAll	(UpdateListener* ul)
 {
-	for (unsigned i=0; i<mParameters.size(); i++) getParameter(i).addUpdateListener (*ul);
+	addListener (ul, kAmsynthParameterCount);
 }
 
 std::string
@@ -156,7 +166,7 @@ Preset::toString()
 	stream << "amSynth1.0preset" << std::endl;
 	stream << "<preset> " << "<name> " << getName() << std::endl;
 	for (unsigned n = 0; n < ParameterCount(); n++) {
-		stream << "<parameter> " << getParameter(n).getName() << " " << getParameter(n).getValue() << std::endl;
+		stream << "<parameter> " << parameter_name_from_index(n) << " " << getValue(n) << std::endl;
 	}
 	return stream.str();
 }
@@ -194,8 +204,9 @@ Preset::fromString(std::string str)
 			stream >> buffer;
 			name = buffer;
 			stream >> buffer;
-			if (name!="unused")
-				getParameter(name).setValue(Parameter::valueFromString(buffer));
+			const int index = parameter_index_from_name(name.c_str());
+			if (index != -1)
+				setValue(index, Parameter::valueFromString(buffer));
 			stream >> buffer;
 		}
 	};
@@ -204,49 +215,29 @@ Preset::fromString(std::string str)
 
 void get_parameter_properties(int parameter_index, double *minimum, double *maximum, double *default_value, double *step_size)
 {
-    Preset preset;
-    Parameter &parameter = preset.getParameter(parameter_index);
+    const ParameterSpec &spec = Parameter::getSpec(parameter_index);
     
     if (minimum) {
-        *minimum = parameter.getMin();
+        *minimum = spec.min;
     }
     if (maximum) {
-        *maximum = parameter.getMax();
+        *maximum = spec.max;
     }
     if (default_value) {
-        *default_value = parameter.getValue();
+        *default_value = spec.constrain(spec.def);
     }
     if (step_size) {
-        *step_size = parameter.getStep();
+        *step_size = spec.inc;
     }
 }
 
-/* this implements the C API in controls.h */
-
-static Preset _preset;
-
-const char *parameter_name_from_index (int param_index)
-{
-	if (param_index >= (int)_preset.ParameterCount())
-		return NULL;
-	return _preset.getParameter(param_index).getName().c_str();
-}
-
-int parameter_index_from_name (const char *param_name)
-{
-	for (unsigned i=0; i<_preset.ParameterCount(); i++) {
-		if (std::string(param_name) == _preset.getParameter(i).getName()) {
-			return i;
-		}
-	}
-	return -1;
-}
+/* this implements the rest of the C API in controls.h, see also Parameter.cc */
 
 int parameter_get_display (int parameter_index, float parameter_value, char *buffer, size_t maxlen)
 {
-	Parameter parameter = _preset.getParameter(parameter_index);
-	parameter.setValue(parameter_value);
-	float real_value = parameter.getControlValue();
+	const ParameterSpec &spec = Parameter::getSpec(parameter_index);
+	const float value = spec.constrain(parameter_value);
+	const float real_value = spec.controlValue(value);
 	
 	switch (parameter_index) {
 		case kAmsynthParameter_AmpEnvAttack:
@@ -283,17 +274,15 @@ int parameter_get_display (int parameter_index, float parameter_value, char *buf
 		case kAmsynthParameter_ReverbWet:
 		case kAmsynthParameter_ReverbWidth:
 		case kAmsynthParameter_AmpDistortion:
-			return snprintf(buffer, maxlen, "%d %%", (int)roundf(parameter.GetNormalisedValue() * 100.0));
+			return snprintf(buffer, maxlen, "%d %%", (int)roundf((value - spec.min) / (spec.max - spec.min) * 100.0));
 			break;
 		case kAmsynthParameter_FilterType:
-			return snprintf(buffer, maxlen, "%s", filter_type_names[(int)real_value]);
+			return snprintf(buffer, maxlen, "%s", spec.value_strings[(int)real_value]);
 	}
 	return 0;
 }
 
 const char **parameter_get_value_strings (int parameter_index)
 {
-	Parameter parameter = _preset.getParameter(parameter_index);
-	const char **value_strings = parameter.valueStrings();
-	return value_strings;
+	return Parameter::getSpec(parameter_index).value_strings;
 }
@@ -37,31 +37,53 @@ class Preset
 {
 public:
 	Preset(const std::string name = "");
+	Preset(const Preset &);
+	~Preset();
 					
 	Preset&			operator =		(const Preset& p);
 	
 	bool			isEqual			(const Preset &);
 
-	const std::string getName		() const { return mName; }
-	void			setName			(const std::string name) { mName = name; }
+	const std::string &getName		() const { return mName; }
+	void			setName			(const std::string &name) { mName = name; }
+
+	// the raw parameter values, see Parameter::getValue()
+	float			getValue		(int no) const { return mValues[no]; }
+	void			setValue		(int no, float value);
 	
-	Parameter&		getParameter	(const std::string name);
+	Parameter&		getParameter	(const char *name);
+	Parameter&		getParameter	(const std::string &name) { return getParameter(name.c_str()); }
 	Parameter&		getParameter	(const int no) { return mParameters[no]; };
 	const Parameter& getParameter	(const int no) const { return mParameters[no]; };
 	
-	unsigned		ParameterCount	() const { return mParameters.size(); }
+	unsigned		ParameterCount	() const { return kAmsynthParameterCount; }
 	
     void			randomise		();
     
+    // listeners are notified of changes to param, or every parameter if param is kAmsynthParameterCount
+    void			addListener		(UpdateListener*, Param param);
+    void			removeListener	(UpdateListener*, Param param);
     void			AddListenerToAll(UpdateListener*);
     
     std::string		toString		();
     bool			fromString		(std::string str);
 
 private:
+	void			notify			(int no);
+	void			bindParameters	();
+
+	struct Listener {
+		UpdateListener *	listener;
+		Param				param;
+	};
+
     std::string				mName;
-	std::vector<Parameter>	mParameters;
-	Parameter				nullparam;
+	float					mValues[kAmsynthParameterCount];
+	std::vector<Listener>	mListeners;
+	// Parameter objects handed out by getParameter(), bound to this preset by
+	// the constructors, so nothing is allocated when they are first used.
+	// The last one is the "null" parameter, returned for unknown names.
+	Parameter				mParameters[kAmsynthParameterCount + 1];
 };
 
 #endif
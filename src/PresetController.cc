@@ -21,14 +21,22 @@
 
 #include "PresetController.h"
 
+#include "BinaryBank.h"
+#include "controls.h"
+#include "Thread.h"
+
 #include <algorithm>
 #include <iostream>
 #include <cassert>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <dirent.h>
+#include <map>
 #include <string>
 #include <fstream>
+#include <sstream>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -38,15 +46,106 @@ using namespace std;
 
 PresetController::PresetController	()
 :	updateListener (0)
+,	sharedBank (NULL)
 ,	nullpreset ("null preset")
 ,	currentPresetNo (-1)
+,	lastPresetsFileModifiedTime (0)
 {
 	presets = new Preset [kNumPresets];
+	// so that selectPreset() doesn't allocate when called from the audio thread
+	currentPreset.setName(std::string(64, ' '));
+	currentPreset.setName("");
 }
 
-PresetController::~PresetController	()
+//
+// A host running many plugin instances would otherwise parse and store the
+// same bank once per instance. Banks are parsed once into a SharedBank, which
+// every PresetController that loads the same file (path, mtime and size) points
+// its presets at. The presets are copied by the first modification of a bank,
+// see detachSharedBank(). A SharedBank is freed when its last user releases it.
+//
+// A binary bank stays mapped while it is shared. Only the preset names are read
+// when it is loaded, each preset's values are read on first use by getPreset(),
+// or all at once by readAllPresets() before the audio thread may use the bank.
+//
+
+struct SharedBank
+{
+	SharedBank();
+	~SharedBank();
+
+	// may block, and read the file, unless the preset has been read already
+	const Preset &	getPreset	(int preset);
+
+	std::string filename;
+	time_t mtime;
+	off_t size;
+	int refcount;		// guarded by s_shared_banks_mutex
+	Preset *presets;
+	BinaryBank *binary;
+	// Guards reading presets from binary, it is held for no longer than it takes
+	// to read one preset. Once a preset is read, getPreset() doesn't take it.
+	pthread_mutex_t read_mutex;
+	volatile bool read[PresetController::kNumPresets];
+};
+
+SharedBank::SharedBank()
+:	mtime (0)
+,	size (0)
+,	refcount (1)
+,	presets (new Preset [PresetController::kNumPresets])
+,	binary (NULL)
+{
+	pthread_mutex_init(&read_mutex, NULL);
+	for (int i = 0; i < PresetController::kNumPresets; i++)
+		read[i] = true;
+}
+
+SharedBank::~SharedBank()
 {
 	delete[] presets;
+	delete binary;
+	pthread_mutex_destroy(&read_mutex);
+}
+
+const Preset &
+SharedBank::getPreset(int preset)
+{
+	if (!read[preset]) {
+		pthread_mutex_lock(&read_mutex);
+		if (!read[preset]) {
+			binary->readPreset(preset, presets[preset]);
+			__sync_synchronize();
+			read[preset] = true;
+		}
+		pthread_mutex_unlock(&read_mutex);
+	}
+	__sync_synchronize();
+	return presets[preset];
+}
+
+static void release_shared_bank(SharedBank *bank);
+
+PresetController::~PresetController	()
+{
+	if (sharedBank)
+		release_shared_bank(sharedBank);
+	else
+		delete[] presets;
+}
+
+const Preset &
+PresetController::getPreset			(int preset) const
+{
+	return sharedBank ? sharedBank->getPreset(preset) : presets[preset];
+}
+
+void
+PresetController::readAllPresets	() const
+{
+	if (sharedBank)
+		for (int i = 0; i < kNumPresets; i++)
+			sharedBank->getPreset(i);
 }
 
 int
@@ -65,7 +164,7 @@ PresetController::selectPreset		(const int preset)
 int 
 PresetController::selectPreset		(const string name)
 {
-	for (int i=0; i<kNumPresets; i++) if (getPreset(i).getName() == name) return selectPreset (i);
+	for (int i=0; i<kNumPresets; i++) if (presets[i].getName() == name) return selectPreset (i);
 	return -1;
 }
 
@@ -73,25 +172,33 @@ bool
 PresetController::containsPresetWithName(const string name)
 {
 	for (int i=0; i<kNumPresets; i++) 
-		if (getPreset(i).getName() == name) 
+		if (presets[i].getName() == name) 
 			return true;
 	return false;
 }
 
-Preset&
-PresetController::getPreset			(const string name)
+const Preset &
+PresetController::getPreset			(const string name) const
 {
-	for (int i=0; i<kNumPresets; i++) if (getPreset(i).getName() == name) return getPreset (i);
+	for (int i=0; i<kNumPresets; i++) if (presets[i].getName() == name) return getPreset (i);
 	return nullpreset;
 }
 
 int
 PresetController::newPreset			()
 {
-	for (int i=0; i<kNumPresets; i++) if (getPreset(i).getName() == "New Preset") return selectPreset (i);
+	for (int i=0; i<kNumPresets; i++) if (presets[i].getName() == "New Preset") return selectPreset (i);
 	return -1;
 }
 
+void
+PresetController::commitPreset		()
+{
+	detachSharedBank ();
+	presets[currentPresetNo] = currentPreset;
+	notify ();
+}
+
 void
 PresetController::deletePreset		()
 {
@@ -128,37 +235,61 @@ static unsigned long mtime(const char *filename)
 	return st.st_mtime;
 }
 
+// Banks are written to a temporary file which then replaces the bank file, as
+// the old file may be mapped by a SharedBank and must not be truncated.
+static std::string temporary_path(const char *filename)
+{
+	ostringstream path;
+	path << filename << "." << getpid() << ".tmp";
+	return path.str();
+}
+
+static int replace_file(const std::string &temporary, const char *filename)
+{
+	if (rename(temporary.c_str(), filename) != 0) {
+		unlink(temporary.c_str());
+		return -1;
+	}
+	return 0;
+}
+
 int 
 PresetController::savePresets		(const char *filename)
 {
 	if (filename == NULL)
 		filename = bank_file.c_str();
 
-	ofstream file( filename, ios::out );
+	const std::string temporary = temporary_path(filename);
+	ofstream file( temporary.c_str(), ios::out );
   
 	file << "amSynth" << endl;
 	for (int i = 0; i < kNumPresets; i++) {
-		if (presets[i].getName()!="unused"){
+		const Preset &preset = getPreset(i);
+		if (preset.getName()!="unused"){
 #ifdef _DEBUG
 			cout << "<PresetController::savePresets():- preset: name= "
-			<< presets[i].getName() << endl;
+			<< preset.getName() << endl;
 #endif
-			file << "<preset> " << "<name> " << presets[i].getName() << endl;
-			for (unsigned n = 0; n < presets[i].ParameterCount(); n++)
+			file << "<preset> " << "<name> " << preset.getName() << endl;
+			for (unsigned n = 0; n < preset.ParameterCount(); n++)
 			{
 #ifdef _DEBUG
 				cout << "PresetController::savePresets() :- parameter name="
-				<< presets[i].getParameter(n).getName() << " value= "
-				<< presets[i].getParameter(n).getValue() << endl;
+				<< parameter_name_from_index(n) << " value= "
+				<< preset.getValue(n) << endl;
 #endif
 				file << "<parameter> " 
-				<< presets[i].getParameter(n).getName()
-				<< " " << presets[i].getParameter(n).getValue() << endl;
+				<< parameter_name_from_index(n)
+				<< " " << preset.getValue(n) << endl;
 			}
 		}
 	}
 	file << "EOF" << endl;
 	file.close();
+	if (file.fail() || replace_file(temporary, filename) != 0) {
+		unlink(temporary.c_str());
+		return -1;
+	}
 #ifdef _DEBUG
 	cout << "<PresetController::savePresets() success" << endl;
 #endif
@@ -169,20 +300,49 @@ PresetController::savePresets		(const char *filename)
 	return 0;
 }
 
-int 
-PresetController::loadPresets		(const char *filename)
+int
+PresetController::savePresetsBinary	(const char *filename)
 {
-	if (filename == NULL)
-		filename = bank_file.c_str();
+	Preset *copy = new Preset [kNumPresets];
+	for (int i = 0; i < kNumPresets; i++)
+		copy[i] = getPreset(i);
+	const std::string temporary = temporary_path(filename);
+	const int result = BinaryBank::write(temporary.c_str(), copy, kNumPresets);
+	delete[] copy;
+	if (result != 0 || replace_file(temporary, filename) != 0) {
+		unlink(temporary.c_str());
+		return -1;
+	}
+
+	lastPresetsFileModifiedTime = mtime(filename);
+	bank_file = std::string(filename);
+
+	return 0;
+}
+
+void
+PresetController::adoptPresets		(PresetController &other)
+{
+	std::swap(presets, other.presets);
+	std::swap(sharedBank, other.sharedBank);
+	bank_file.swap(other.bank_file);
+	std::swap(lastPresetsFileModifiedTime, other.lastPresetsFileModifiedTime);
+	currentPresetNo = -1;
+	notify ();
+}
+
+///////////////////////////////////
+
+static pthread_mutex_t s_shared_banks_mutex = PTHREAD_MUTEX_INITIALIZER;
+static std::map<std::string, SharedBank *> s_shared_banks;
 
+// reads a text bank file into presets, which must hold kNumPresets
+static int read_text_bank(const char *filename, Preset *presets)
+{
 #ifdef _DEBUG
-	cout << "<PresetController::loadPresets()>" << endl;
+	cout << "<PresetController::read_text_bank()>" << endl;
 #endif
 
-	if (strcmp(filename, bank_file.c_str()) == 0 && lastPresetsFileModifiedTime == mtime(filename)) {
-		return 0; // file not modified since last load
-	}
-
 	ifstream file;
 	string buffer;
 
@@ -197,15 +357,12 @@ PresetController::loadPresets		(const char *filename)
 	if (buffer != "amSynth") {
 #ifdef _DEBUG
 		cout <<
-		"<PresetController::loadPresets()> not an amSynth file, bailing out"
+		"<PresetController::read_text_bank()> not an amSynth file, bailing out"
 		<< endl;
 #endif
 	return -1;
 	}
 
-	delete[] presets;
-	presets = new Preset [kNumPresets];
-
 	int preset = -1;
 	file >> buffer;
 	while (file.good()) {
@@ -229,7 +386,7 @@ PresetController::loadPresets		(const char *filename)
 				file >> buffer;
 			}
 #ifdef _DEBUG
-			cout << "<PresetController::loadPresets()>: Preset name: "
+			cout << "<PresetController::read_text_bank()>: Preset name: "
 			<< presetName << endl;
 #endif
 			presets[preset].setName(presetName);
@@ -240,21 +397,22 @@ PresetController::loadPresets		(const char *filename)
 				name = buffer;
 				file >> buffer;
 #ifdef _DEBUG
-				cout << "<PresetController::loadPresets()>: Parameter:- name="
+				cout << "<PresetController::read_text_bank()>: Parameter:- name="
 				<< name << " value=" << buffer << endl;
 #endif
 
-				Parameter &param = presets[preset].getParameter(name);
-				if (param.getName() == name) // make sure parameter name is supported
+				const int index = parameter_index_from_name(name.c_str());
+				if (index != -1) // make sure parameter name is supported
 				{
 					float fval = Parameter::valueFromString(buffer);
-					param.setValue(fval);
-					if (param.getValue() != fval)
+					presets[preset].setValue(index, fval);
+					if (presets[preset].getValue(index) != fval)
 					{
+						const ParameterSpec &spec = Parameter::getSpec(index);
 						cerr << "warning: parameter '" << name  << 
 							"' could not be set to value: " << fval << 
-							" (min = " << param.getMin() << ", max = " << 
-							param.getMax() << ")" << endl;
+							" (min = " << spec.min << ", max = " << 
+							spec.max << ")" << endl;
 					}
 				}
 				file >> buffer;
@@ -264,53 +422,297 @@ PresetController::loadPresets		(const char *filename)
 		}
 	}
 
+#ifdef _DEBUG
+	cout << "<PresetController::read_text_bank()>: success" << endl;
+#endif
+
+	return 0;
+}
+
+// reads filename into a new SharedBank, or returns NULL if it isn't a valid bank
+static SharedBank *read_shared_bank(const char *filename, const struct stat &st)
+{
+	SharedBank *bank = new SharedBank;
+	bank->filename = filename;
+	bank->mtime = st.st_mtime;
+	bank->size = st.st_size;
+
+	if (BinaryBank::isBinaryBank(filename)) {
+		bank->binary = new BinaryBank;
+		if (bank->binary->open(filename) != 0) {
+			delete bank;
+			return NULL;
+		}
+		// only the index is read now, preset values are read on first access
+		const unsigned count = std::min(bank->binary->getPresetCount(), (unsigned)PresetController::kNumPresets);
+		for (unsigned i = 0; i < count; i++) {
+			bank->presets[i].setName(bank->binary->getPresetName(i));
+			bank->read[i] = false;
+		}
+	} else if (read_text_bank(filename, bank->presets) != 0) {
+		delete bank;
+		return NULL;
+	}
+	return bank;
+}
+
+// the bank for filename if it is loaded and up to date, with a reference added
+static SharedBank *
+find_shared_bank(const char *filename, const struct stat &st)
+{
+	std::map<std::string, SharedBank *>::iterator it = s_shared_banks.find(filename);
+	if (it == s_shared_banks.end() || it->second->mtime != st.st_mtime || it->second->size != st.st_size)
+		return NULL;
+	it->second->refcount++;
+	return it->second;
+}
+
+SharedBank *
+PresetController::acquireSharedBank	(const char *filename)
+{
+	struct stat st;
+	if (stat(filename, &st) != 0)
+		return NULL;
+
+	pthread_mutex_lock(&s_shared_banks_mutex);
+	SharedBank *bank = find_shared_bank(filename, st);
+	pthread_mutex_unlock(&s_shared_banks_mutex);
+	if (bank)
+		return bank;
+
+	// The file is read without the lock, so that a slow load (such as the bank
+	// scan) doesn't hold up loads of other banks. Two threads may read the same
+	// bank at once, in which case the second to finish uses the first's.
+	SharedBank *loaded = read_shared_bank(filename, st);
+	if (!loaded)
+		return NULL;
+
+	pthread_mutex_lock(&s_shared_banks_mutex);
+	bank = find_shared_bank(filename, st);
+	if (!bank) {
+		// an out of date bank stays alive until its users release it
+		s_shared_banks[filename] = loaded;
+		bank = loaded;
+		loaded = NULL;
+	}
+	pthread_mutex_unlock(&s_shared_banks_mutex);
+
+	delete loaded;
+	return bank;
+}
+
+static void
+release_shared_bank(SharedBank *bank)
+{
+	pthread_mutex_lock(&s_shared_banks_mutex);
+	if (--bank->refcount == 0) {
+		std::map<std::string, SharedBank *>::iterator it = s_shared_banks.find(bank->filename);
+		if (it != s_shared_banks.end() && it->second == bank)
+			s_shared_banks.erase(it);
+		delete bank;
+	}
+	pthread_mutex_unlock(&s_shared_banks_mutex);
+}
+
+void
+PresetController::detachSharedBank	()
+{
+	if (!sharedBank)
+		return;
+	Preset *copy = new Preset [kNumPresets];
+	for (int i = 0; i < kNumPresets; i++)
+		copy[i] = getPreset(i);
+	presets = copy;
+	release_shared_bank(sharedBank);
+	sharedBank = NULL;
+}
+
+int 
+PresetController::loadPresets		(const char *filename)
+{
+	if (filename == NULL)
+		filename = bank_file.c_str();
+
+	if (strcmp(filename, bank_file.c_str()) == 0 && lastPresetsFileModifiedTime == mtime(filename)) {
+		return 0; // file not modified since last load
+	}
+
+	SharedBank *bank = acquireSharedBank(filename);
+	if (!bank)
+		return -1;
+
+	if (sharedBank)
+		release_shared_bank(sharedBank);
+	else
+		delete[] presets;
+	sharedBank = bank;
+	presets = bank->presets;
+
 	bank_file = std::string(filename);
-	lastPresetsFileModifiedTime = mtime(filename);
+	lastPresetsFileModifiedTime = bank->mtime;
 
 	notify ();
-	
-#ifdef _DEBUG
-	cout << "<PresetController::loadPresets()>: success" << endl;
-#endif
 
 	return 0;
 }
 
 ///////////////////////////////////
 
+//
+// Loading every bank file just to check that it is valid gets slow with large
+// libraries, so the results are kept in a cache file. A bank file is only
+// parsed if it is not in the cache, or if its mtime or size has changed.
+//
+// getPresetBanks() initially returns the banks which are already in the cache,
+// new or modified files are parsed by a background thread and the updated list
+// is picked up by updatePresetBanks(). That thread runs again every few seconds
+// while the list is being polled, so banks which are added, removed or edited
+// later on show up too.
+//
+
+static const time_t kBankRescanInterval = 5; // seconds
+
+struct BankCacheEntry {
+	time_t mtime;
+	off_t size;
+	bool valid;
+	std::string name;
+};
+
+typedef std::map<std::string, BankCacheEntry> BankCache;
+
 static std::vector<BankInfo> s_banks;
+static bool s_banks_scanned = false;
 
-static void scan_preset_bank(const std::string dir_path, const std::string file_name, bool read_only)
+// only used by one thread at a time, see BankScanThread
+static BankCache s_bank_cache;
+static bool s_bank_cache_loaded = false;
+
+// written by the scan thread, picked up by updatePresetBanks()
+static pthread_mutex_t s_scanned_banks_mutex = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<BankInfo> s_scanned_banks;
+static bool s_scanned_banks_ready = false;
+
+static std::string bank_cache_path()
 {
-	std::string file_path = dir_path + std::string("/") + std::string(file_name);
+	return std::string(getenv("HOME")) + std::string("/.amsynth/banks.cache");
+}
 
-	std::string bank_name = std::string(file_name);
-	if (bank_name == std::string(".amSynth.presets")) {
-		bank_name = "User bank";
-	} else {
-		std::string::size_type pos = bank_name.find_first_of(".");
-		if (pos != std::string::npos)
-			bank_name.erase(pos, string::npos);
+static void load_bank_cache(BankCache &cache)
+{
+	ifstream file(bank_cache_path().c_str());
+	string line;
+	if (!getline(file, line) || line != "amSynthBankCache 1")
+		return;
+
+	BankCacheEntry *entry = NULL;
+	while (getline(file, line)) {
+		string::size_type tab = line.find('\t');
+		if (tab == string::npos)
+			continue;
+		const string key = line.substr(0, tab), value = line.substr(tab + 1);
+		if (key == "bank") {
+			// bank <tab> mtime <tab> size <tab> valid <tab> path
+			istringstream stream(value);
+			long long mtime = 0, size = 0;
+			int valid = 0;
+			string path;
+			stream >> mtime >> size >> valid;
+			stream.get();
+			getline(stream, path);
+			if (stream.fail() || path.empty()) {
+				entry = NULL;
+				continue;
+			}
+			entry = &cache[path];
+			entry->mtime = (time_t)mtime;
+			entry->size = (off_t)size;
+			entry->valid = valid != 0;
+			entry->name.clear();
+		} else if (entry && key == "name") {
+			entry->name = value;
+		}
 	}
+}
 
-	std::replace(bank_name.begin(), bank_name.end(), '_', ' ');
+static void save_bank_cache(const BankCache &cache)
+{
+	ostringstream tmp_path;
+	tmp_path << bank_cache_path() << "." << getpid();
 
-	PresetController preset_controller;
-	if (preset_controller.loadPresets(file_path.c_str()) != 0)
+	ofstream file(tmp_path.str().c_str());
+	if (!file.good())
 		return;
 
-	BankInfo bank_info;
-	bank_info.name = bank_name;
-	bank_info.file_path = file_path;
-	bank_info.read_only = read_only;
-	s_banks.push_back(bank_info);
+	file << "amSynthBankCache 1" << endl;
+	for (BankCache::const_iterator it = cache.begin(); it != cache.end(); ++it) {
+		const BankCacheEntry &entry = it->second;
+		file << "bank\t" << (long long)entry.mtime << "\t" << (long long)entry.size << "\t" << (entry.valid ? 1 : 0) << "\t" << it->first << endl;
+		file << "name\t" << entry.name << endl;
+	}
+	file.close();
+
+	// another instance may be writing the cache too, so replace it atomically
+	if (file.fail() || rename(tmp_path.str().c_str(), bank_cache_path().c_str()) != 0)
+		unlink(tmp_path.str().c_str());
 }
 
-static void scan_preset_banks(const std::string dir_path, bool read_only)
+// returns false if the file is not in the cache and parse_files is false
+static bool scan_preset_bank(const std::string dir_path, const std::string file_name, bool read_only,
+                             bool parse_files, const BankCache &old_cache, BankCache &new_cache,
+                             std::vector<BankInfo> &banks)
+{
+	std::string file_path = dir_path + std::string("/") + std::string(file_name);
+
+	struct stat st;
+	if (stat(file_path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+		return true;
+
+	BankCache::const_iterator cached = old_cache.find(file_path);
+	if (cached != old_cache.end() && cached->second.mtime == st.st_mtime && cached->second.size == st.st_size) {
+		new_cache[file_path] = cached->second;
+	} else {
+		if (!parse_files)
+			return false;
+
+		std::string bank_name = std::string(file_name);
+		if (bank_name == std::string(".amSynth.presets")) {
+			bank_name = "User bank";
+		} else {
+			std::string::size_type pos = bank_name.find_first_of(".");
+			if (pos != std::string::npos)
+				bank_name.erase(pos, string::npos);
+		}
+
+		std::replace(bank_name.begin(), bank_name.end(), '_', ' ');
+
+		BankCacheEntry &entry = new_cache[file_path];
+		entry.mtime = st.st_mtime;
+		entry.size = st.st_size;
+		entry.name = bank_name;
+
+		PresetController preset_controller;
+		entry.valid = preset_controller.loadPresets(file_path.c_str()) == 0;
+	}
+
+	const BankCacheEntry &entry = new_cache[file_path];
+	if (entry.valid) {
+		BankInfo bank_info;
+		bank_info.name = entry.name;
+		bank_info.file_path = file_path;
+		bank_info.read_only = read_only;
+		banks.push_back(bank_info);
+	}
+	return true;
+}
+
+static bool scan_preset_banks(const std::string dir_path, bool read_only,
+                              bool parse_files, const BankCache &old_cache, BankCache &new_cache,
+                              std::vector<BankInfo> &banks)
 {
 	DIR *dir = opendir(dir_path.c_str());
 	if (!dir)
-		return;
+		return true;
 
 	std::vector<std::string> filenames;
 
@@ -325,29 +727,126 @@ static void scan_preset_banks(const std::string dir_path, bool read_only)
 
 	std::sort(filenames.begin(), filenames.end());
 
+	bool complete = true;
 	for (std::vector<std::string>::iterator it = filenames.begin(); it != filenames.end(); ++it)
-		scan_preset_bank(dir_path, *it, read_only);
+		complete &= scan_preset_bank(dir_path, *it, read_only, parse_files, old_cache, new_cache, banks);
+	return complete;
 }
 
-static void scan_preset_banks()
+// Scans all bank directories into banks. If parse_files is false, files which
+// are not in the cache are skipped and false is returned. Otherwise changed is
+// set if any bank was added, removed or modified since the last scan.
+static bool scan_preset_banks(bool parse_files, std::vector<BankInfo> &banks, bool *changed = NULL)
 {
-	s_banks.clear();
-	scan_preset_bank(std::string(getenv("HOME")), ".amSynth.presets", false);
-	scan_preset_banks(PresetController::getUserBanksDirectory(), false);
-	scan_preset_banks(PresetController::getFactoryBanksDirectory(), true);
+	if (!s_bank_cache_loaded) {
+		load_bank_cache(s_bank_cache);
+		s_bank_cache_loaded = true;
+	}
+
+	BankCache new_cache;
+	bool complete = true;
+	complete &= scan_preset_bank(std::string(getenv("HOME")), ".amSynth.presets", false, parse_files, s_bank_cache, new_cache, banks);
+	complete &= scan_preset_banks(PresetController::getUserBanksDirectory(), false, parse_files, s_bank_cache, new_cache, banks);
+	complete &= scan_preset_banks(PresetController::getFactoryBanksDirectory(), true, parse_files, s_bank_cache, new_cache, banks);
+
+	if (complete) {
+		bool cache_changed = new_cache.size() != s_bank_cache.size();
+		for (BankCache::const_iterator it = new_cache.begin(); !cache_changed && it != new_cache.end(); ++it) {
+			BankCache::const_iterator old = s_bank_cache.find(it->first);
+			cache_changed = old == s_bank_cache.end() || old->second.mtime != it->second.mtime || old->second.size != it->second.size;
+		}
+		s_bank_cache.swap(new_cache);
+		if (cache_changed)
+			save_bank_cache(s_bank_cache);
+		if (changed)
+			*changed = cache_changed;
+	}
+	return complete;
 }
 
+// s_bank_cache belongs to this thread while it runs, the GUI thread must
+// wait() for it before scanning itself.
+class BankScanThread : public Thread
+{
+public:
+	BankScanThread() : mStarted(false), mFinished(true) {}
+	~BankScanThread() { wait(); }
+
+	void start() { wait(); mFinished = false; mStarted = (Run() == 0); mFinished = !mStarted; }
+	void wait() { if (mStarted) { Join(); mStarted = false; } }
+	bool finished() const { return mFinished; }
+
+protected:
+	void ThreadAction()
+	{
+		std::vector<BankInfo> banks;
+		bool changed = false;
+		scan_preset_banks(true, banks, &changed);
+		if (changed) {
+			pthread_mutex_lock(&s_scanned_banks_mutex);
+			s_scanned_banks.swap(banks);
+			s_scanned_banks_ready = true;
+			pthread_mutex_unlock(&s_scanned_banks_mutex);
+		}
+		mFinished = true;
+	}
+
+private:
+	bool mStarted;
+	volatile bool mFinished;
+};
+
+static BankScanThread s_scan_thread;
+static time_t s_last_scan_time = 0;
+
 const std::vector<BankInfo> &
 PresetController::getPresetBanks()
 {
-	if (!s_banks.size())
-		scan_preset_banks();
+	if (!s_banks_scanned) {
+		s_banks_scanned = true;
+		s_banks.clear();
+		s_last_scan_time = time(NULL);
+		if (!scan_preset_banks(false, s_banks))
+			s_scan_thread.start();
+	}
 	return s_banks;
 }
 
+bool
+PresetController::updatePresetBanks()
+{
+	bool changed = false;
+	pthread_mutex_lock(&s_scanned_banks_mutex);
+	if (s_scanned_banks_ready) {
+		s_banks.swap(s_scanned_banks);
+		s_scanned_banks.clear();
+		s_scanned_banks_ready = false;
+		changed = true;
+	}
+	pthread_mutex_unlock(&s_scanned_banks_mutex);
+
+	// look for banks which have changed on disk since the last scan
+	const time_t now = time(NULL);
+	if (s_banks_scanned && s_scan_thread.finished() && (now - s_last_scan_time >= kBankRescanInterval || now < s_last_scan_time)) {
+		s_last_scan_time = now;
+		s_scan_thread.start();
+	}
+	return changed;
+}
+
 void PresetController::rescanPresetBanks()
 {
-	scan_preset_banks();
+	s_scan_thread.wait();
+
+	pthread_mutex_lock(&s_scanned_banks_mutex);
+	s_scanned_banks.clear();
+	s_scanned_banks_ready = false;
+	pthread_mutex_unlock(&s_scanned_banks_mutex);
+
+	s_banks.clear();
+	scan_preset_banks(true, s_banks);
+	s_banks_scanned = true;
+	s_last_scan_time = time(NULL);
 }
 
 std::string PresetController::getFactoryBanksDirectory()
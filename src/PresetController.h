@@ -28,6 +28,8 @@
 #include "Preset.h"
 #include "UpdateListener.h"
 
+struct SharedBank;
+
 struct BankInfo {
 	std::string name;
 	std::string file_path;
@@ -50,16 +52,21 @@ public:
 	// returns the preset currently being edited
 	Preset&	getCurrentPreset	() { return currentPreset; }
 	
-	// access presets in the memory bank
-	Preset&	getPreset			(int preset) { return presets[preset]; }
-	const Preset & getPreset	(int preset) const { return presets[preset]; }
-	Preset&	getPreset			(const std::string name);
+	// access presets in the memory bank. The values of a binary bank's presets
+	// are read from the file on first access, see SharedBank in PresetController.cc
+	const Preset & getPreset	(int preset) const;
+	const Preset & getPreset	(const std::string name) const;
+
+	// Reads every preset of a binary bank now, after which getPreset() and
+	// selectPreset() never touch the file. Call it from a thread which may block,
+	// before the bank can be used by the audio thread.
+	void	readAllPresets		() const;
 
 	bool	containsPresetWithName(const std::string name);
-	bool	isCurrentPresetModified() { return !currentPreset.isEqual(presets[currentPresetNo]); }
+	bool	isCurrentPresetModified() { return !currentPreset.isEqual(getPreset(currentPresetNo)); }
 	
 	// Commit the current preset to memory
-	void	commitPreset		() { presets[currentPresetNo] = currentPreset; notify(); }
+	void	commitPreset		();
 
 	// Selects a new, unused preset ready for editing.
 	int		newPreset			();
@@ -70,8 +77,17 @@ public:
 	int		importPreset		(const std::string filename);
 	
 	// Loading & Saving of bank files
+	// loadPresets() accepts both text and binary (see BinaryBank.h) bank files.
+	// Loaded banks are shared with every other PresetController in the process
+	// which loads the same unmodified file, see SharedBank in PresetController.cc
 	int		loadPresets			(const char *filename = NULL);
 	int		savePresets			(const char *filename = NULL);
+	int		savePresetsBinary	(const char *filename);
+
+	// Takes the presets and bank file of other, which gets ours in exchange.
+	// Only pointers are swapped, so this is safe to call from the audio thread.
+	// No preset is current afterwards, the caller should selectPreset().
+	void	adoptPresets		(PresetController &other);
 
     void	setUpdateListener	(UpdateListener & ul) { updateListener = &ul; }
 
@@ -79,7 +95,13 @@ public:
 
 	const std::string & getFilePath() { return bank_file; }
 
+	// The list may be incomplete at first, when files new to the cache are being
+	// read in the background. updatePresetBanks() returns true once that has
+	// finished and the list has changed, views showing it should poll it and
+	// then call getPresetBanks() again. While it is polled, the bank files are
+	// checked for changes every few seconds. Only call these from the GUI thread.
 	static const std::vector<BankInfo> & getPresetBanks();
+	static bool updatePresetBanks();
 	static void rescanPresetBanks();
     
 	static std::string getFactoryBanksDirectory();
@@ -89,9 +111,15 @@ protected:
 	void	notify				() { if (updateListener) updateListener->update(); }
 
 private:
+	// gives us our own copy of the presets, so they can be modified
+	void	detachSharedBank	();
+
+	static SharedBank *	acquireSharedBank	(const char *filename);
+
 	std::string		bank_file;
 	UpdateListener*	updateListener;
-	Preset*			presets;
+	Preset*			presets;		// owned, or sharedBank's presets, which must not be modified
+	SharedBank*		sharedBank;
 	Preset 			currentPreset;
 	Preset			blankPreset;
 	Preset 			nullpreset;
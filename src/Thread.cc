@@ -0,0 +1,142 @@
+/*
+ *  Thread.cc
+ *
+ *  Copyright (c) 2001-2012 Nick Dowell
+ *
+ *  This file is part of amsynth.
+ *
+ *  amsynth is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  amsynth is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with amsynth.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Thread.h"
+
+#ifndef _MSC_VER
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static ThreadSchedule s_schedules[kThreadClassCount];
+
+static const char *s_class_names[kThreadClassCount] = { "audio", "midi", "worker" };
+
+void
+Thread::setSchedule(ThreadClass threadClass, const ThreadSchedule &schedule)
+{
+	s_schedules[threadClass] = schedule;
+}
+
+const ThreadSchedule &
+Thread::getSchedule(ThreadClass threadClass)
+{
+	return s_schedules[threadClass];
+}
+
+void *
+Thread::start_routine(void *arg)
+{
+	Thread *self = (Thread *) arg;
+	const ThreadSchedule &schedule = s_schedules[self->mClass];
+	int err;
+	if ((err = schedule.applyScheduling(pthread_self())))
+		fprintf(stderr, "<Thread> could not set %s thread scheduling: %s\n", s_class_names[self->mClass], strerror(err));
+	if ((err = schedule.applyAffinity(pthread_self())))
+		fprintf(stderr, "<Thread> could not set %s thread CPU affinity: %s\n", s_class_names[self->mClass], strerror(err));
+	self->ThreadAction ();
+	return NULL;
+}
+
+static bool
+parse_cpus(const std::string &text, std::vector<int> &cpus)
+{
+	cpus.clear();
+	if (text == "all")
+		return true;
+	const char *p = text.c_str();
+	while (*p) {
+		char *end;
+		long first = strtol(p, &end, 10), last = first;
+		if (end == p || first < 0) return false;
+		if (*end == '-') {
+			p = end + 1;
+			last = strtol(p, &end, 10);
+			if (end == p || last < first) return false;
+		}
+		for (long cpu = first; cpu <= last; cpu++)
+			cpus.push_back((int) cpu);
+		if (*end == ',') end++;
+		else if (*end) return false;
+		p = end;
+	}
+	return !cpus.empty();
+}
+
+bool
+ThreadSchedule::parse(const std::string &scheduling, const std::string &cpuList)
+{
+	priority = 0;
+	std::string name = scheduling.substr(0, scheduling.find(':'));
+	if (name == "default") policy = -1;
+	else if (name == "other") policy = SCHED_OTHER;
+#ifdef SCHED_BATCH
+	else if (name == "batch") policy = SCHED_BATCH;
+#endif
+#ifdef SCHED_IDLE
+	else if (name == "idle") policy = SCHED_IDLE;
+#endif
+	else if (name == "fifo") policy = SCHED_FIFO;
+	else if (name == "rr") policy = SCHED_RR;
+	else return false;
+
+	if (policy == SCHED_FIFO || policy == SCHED_RR) {
+		if (name == scheduling)
+			return false;
+		priority = atoi(scheduling.c_str() + name.size() + 1);
+		if (priority < sched_get_priority_min(policy) || priority > sched_get_priority_max(policy))
+			return false;
+	}
+	return parse_cpus(cpuList, cpus);
+}
+
+int
+ThreadSchedule::applyScheduling(pthread_t thread) const
+{
+	if (policy == -1)
+		return 0;
+	struct sched_param param;
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = priority;
+	return pthread_setschedparam(thread, policy, &param);
+}
+
+int
+ThreadSchedule::applyAffinity(pthread_t thread) const
+{
+	if (cpus.empty())
+		return 0;
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (size_t i = 0; i < cpus.size(); i++)
+		if (cpus[i] < CPU_SETSIZE)
+			CPU_SET(cpus[i], &set);
+	return pthread_setaffinity_np(thread, sizeof(set), &set);
+#else
+	return ENOSYS;
+#endif
+}
+
+#endif
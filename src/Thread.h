@@ -22,26 +22,63 @@
 #ifndef _THREAD_H
 #define _THREAD_H
 
+// the kinds of thread amsynth runs, each of which can be scheduled differently
+enum ThreadClass {
+	kAudioThread,
+	kMidiThread,
+	kWorkerThread,		// disk i/o, bank loading etc.
+	kThreadClassCount
+};
+
 #ifdef _MSC_VER
 
 class Thread {
+public:
+	Thread(ThreadClass = kWorkerThread) {}
 };
 
 #else
 
 #include <pthread.h>
 #include <signal.h>
+#include <string>
+#include <vector>
+
+/**
+ * How to schedule a thread, and on which CPUs. See the *_thread_scheduling
+ * and *_thread_cpus settings in Config.
+ */
+struct ThreadSchedule
+{
+	ThreadSchedule() : policy(-1), priority(0) {}
+
+	// scheduling is "default" (inherited from the creating thread), "other",
+	// "batch", "idle", "fifo:<priority>" or "rr:<priority>", and cpus is "all"
+	// or a list like "2,4-5". Returns false if either can't be parsed.
+	bool	parse			(const std::string &scheduling, const std::string &cpus);
+
+	// return 0, or an errno value
+	int		applyScheduling	(pthread_t thread) const;
+	int		applyAffinity	(pthread_t thread) const;
+
+	int					policy;		// a SCHED_* constant, or -1 to leave as inherited
+	int					priority;
+	std::vector<int>	cpus;		// empty for any CPU
+};
 
 class Thread
 {
 public:
-	Thread() : mThread(0), mShouldStop(false) {}
+	Thread(ThreadClass threadClass = kWorkerThread) : mThread(0), mShouldStop(false), mClass(threadClass) {}
 	virtual ~Thread () {}
 	
-	int		Run		() { return pthread_create (&mThread, NULL, Thread::start_routine, this); }
+	int		Run		() { mShouldStop = false; return pthread_create (&mThread, NULL, Thread::start_routine, this); }
 	void	Stop	() { mShouldStop = true; }
-	int		Kill	() { return mThread ? pthread_cancel(mThread) : 0; }
-	int		Join	() { return mThread ? pthread_join(mThread, NULL) : 0; }
+	int		Join	() { int res = mThread ? pthread_join(mThread, NULL) : 0; mThread = 0; return res; }
+
+	// used by every thread of the class which starts afterwards
+	static void	setSchedule	(ThreadClass, const ThreadSchedule &);
+	static const ThreadSchedule &	getSchedule	(ThreadClass);
 
 protected:
 	// override me!
@@ -50,15 +87,11 @@ protected:
 	bool			ShouldStop () { return mShouldStop; }
 
 private:
-	static void* start_routine (void *arg)
-	{
-		Thread *self = (Thread *) arg;
-		self->mShouldStop = false;
-		self->ThreadAction ();
-		pthread_exit (0);
-	}
-	pthread_t	mThread;
-	bool		mShouldStop;
+	static void* start_routine (void *arg);
+
+	pthread_t		mThread;
+	volatile bool	mShouldStop;
+	ThreadClass		mClass;
 };
 
 #endif /* _MSC_VER */
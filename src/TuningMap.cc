@@ -300,3 +300,67 @@ TuningMap::loadKeyMap		(const string & filename)
 	return 0;
 }
 
+// state layout: zeroNote, refNote, refPitch, mapRepeatInc,
+//               scale size, scale..., mapping size, mapping...
+void
+TuningMap::getState		(vector<double> & state) const
+{
+	state.clear();
+	state.push_back(zeroNote);
+	state.push_back(refNote);
+	state.push_back(refPitch);
+	state.push_back(mapRepeatInc);
+	state.push_back(scale.size());
+	state.insert(state.end(), scale.begin(), scale.end());
+	state.push_back(mapping.size());
+	state.insert(state.end(), mapping.begin(), mapping.end());
+}
+
+int
+TuningMap::setState		(const vector<double> & state)
+{
+	if (state.size() < 5)
+		return -1;
+	const int newZeroNote = (int) state[0];
+	const int newRefNote = (int) state[1];
+	const double newRefPitch = state[2];
+	const int newMapRepeatInc = (int) state[3];
+	const size_t scaleSize = (size_t) state[4];
+	if (newZeroNote < 0 || newZeroNote >= 128 ||
+		newRefNote < 0 || newRefNote >= 128 ||
+		!(newRefPitch > 0) || newMapRepeatInc < 0 ||
+		scaleSize == 0 || state.size() < 6 + scaleSize)
+		return -1;
+
+	vector<double> newScale(state.begin() + 5, state.begin() + 5 + scaleSize);
+	for (size_t i = 0; i < newScale.size(); i++)
+		if (!(newScale[i] > 0))
+			return -1;
+
+	const size_t mapSize = (size_t) state[5 + scaleSize];
+	if (mapSize == 0 || state.size() != 6 + scaleSize + mapSize)
+		return -1;
+	vector<int> newMapping;
+	for (size_t i = 6 + scaleSize; i < state.size(); i++) {
+		if (state[i] < -1 || state[i] >= 128 * 128)
+			return -1;
+		newMapping.push_back((int) state[i]);
+	}
+
+	// Check to make sure reference pitch is actually mapped
+	int refIndex = (newRefNote - newZeroNote) % (int) mapSize;
+	if (refIndex < 0)
+		refIndex += mapSize;
+	if (newMapping[refIndex] < 0)
+		return -1;
+
+	zeroNote = newZeroNote;
+	refNote = newRefNote;
+	refPitch = newRefPitch;
+	mapRepeatInc = newMapRepeatInc;
+	scale = newScale;
+	mapping = newMapping;
+	scaleDesc = "";
+	updateBasePitch();
+	return 0;
+}
@@ -50,6 +50,11 @@ public:
 	void	defaultKeyMap		();
 
 	double	noteToPitch		(int note) const;
+
+	// The scale and key map as a flat list of numbers, for saving plugin state.
+	// setState() returns 0 on success, the tuning is unchanged if it fails.
+	void	getState		(std::vector<double> & state) const;
+	int	setState		(const std::vector<double> & state);
 private:
 	std::string		scaleDesc;
 
@@ -34,6 +34,11 @@ public:
 	 
     virtual void update			()		{;}
     virtual void UpdateParameter	(Param, float)	{ update ();}
+
+	// bracket the UpdateParameter() calls made when a whole preset is assigned,
+	// so that listeners can apply them as one change, see Preset::operator=
+	virtual void BeginPresetChange	()		{;}
+	virtual void EndPresetChange	()		{;}
 };
 
 #endif
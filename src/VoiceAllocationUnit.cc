@@ -24,60 +24,280 @@
 #include "Effects/SoftLimiter.h"
 #include "Effects/revmodel.hpp"
 #include "Effects/Distortion.h"
+#include "ParameterSmoother.h"
+#include "MemoryArena.h"
 
+#include <algorithm>
 #include <iostream>
 #include <math.h>
 #include <cstring>
 #include <assert.h>
+#include <time.h>
 
 using namespace std;
 
-const unsigned kBufferSize = 1024;
+// how quickly voices are released when the preset changes, or to shed load
+static const float kRetireReleaseTime = 0.01f; // seconds
+
+// The polyphony governor compares the time taken to render with the duration
+// of the audio rendered, averaged over this many frames, ...
+static const unsigned kGovernorPeriod = 1024;
+// ... sheds voices when that ratio is above kHighLoad, aiming for kTargetLoad,
+// and allows one more voice per period while it is below kLowLoad.
+static const float kHighLoad = 0.8f;
+static const float kTargetLoad = 0.6f;
+static const float kLowLoad = 0.4f;
+
+// of the reverb's numcombs comb filters, how many are used at QualityEco
+static const int kEcoReverbCombs = 4;
+
+enum {
+	kPresetChangeIdle,
+	kPresetChangeWriting,	// between BeginPresetChange() and EndPresetChange()
+	kPresetChangeReady,		// waiting to be applied
+	kPresetChangeApplying
+};
+
+struct VoiceAllocationUnit::Scratch
+{
+	float mix[VoiceBoard::kMaxProcessBufferSize];
+	VoiceBoard::ProcessBuffers voice;
+};
 
-VoiceAllocationUnit::VoiceAllocationUnit ()
+VoiceAllocationUnit::Scratch *
+VoiceAllocationUnit::createScratch	()
+{
+	return new Scratch;
+}
+
+void
+VoiceAllocationUnit::destroyScratch	(Scratch *scratch)
+{
+	delete scratch;
+}
+
+VoiceAllocationUnit::VoiceAllocationUnit (bool hugePages)
 :	mMaxVoices (0)
+,	mEffectiveMaxVoices (128)
+,	mGovernorEnabled (false)
+,	mGovernorTime (0)
+,	mGovernorFrames (0)
+,	mVoiceCost (0)
+,	mDspLoad (0)
+,	mVoicesShed (0)
+,	mVoicesStolen (0)
+,	mParameterChanges (0)
+,	mFrames (0)
+,	mStageTiming (false)
+,	mRequestedSampleRate (44100)
+,	mSampleRate (0)
+,	mRequestedQuality (QualityStandard)
+,	mQuality (QualityStandard)
+,	mBlockSize (kDefaultBlockSize)
 ,	mPortamentoTime (0.0f)
 ,	sustain (0)
 ,	_keyboardMode(KeyboardModePoly)
+,	mPresetChangeState (kPresetChangeIdle)
+,	mPresetChangeWriter (pthread_t())
+,	mPresetChangeMissed (0)
+,	mQueued (0)
 ,	mMasterVol (1.0)
 ,	mPitchBendRangeSemitones(2)
 ,	mLastNoteFrequency (0.0f)
 ,	mLastPitchBendValue(1)
 ,	mNextPitchBendValue(1)
 {
-	limiter = new SoftLimiter;
-	reverb = new revmodel;
-	distortion = new Distortion;
-	mBuffer = new float [kBufferSize * 2];
-
+	// laid out roughly in the order Process() uses them
+	mArena = new MemoryArena;
+	if (!mArena->allocate (MemoryArena::sizeFor<Scratch> () +
+						   MemoryArena::sizeFor<ParameterSmoother> () +
+						   MemoryArena::sizeFor<VoiceBoard> (128) +
+						   MemoryArena::sizeFor<Distortion> () +
+						   MemoryArena::sizeFor<revmodel> () +
+						   MemoryArena::sizeFor<SoftLimiter> (), hugePages)) {
+		delete mArena;
+		throw std::bad_alloc ();
+	}
+	mScratch = mArena->create<Scratch> ();
+	smoother = mArena->create<ParameterSmoother> ();
 	for (int i = 0; i < 128; i++)
 	{
 		keyPressed[i] = false;
 		active[i] = false;
-		_voices.push_back (new VoiceBoard);
+		retiring[i] = false;
+		_voices.push_back (mArena->create<VoiceBoard> ());
+	}
+	distortion = mArena->create<Distortion> ();
+	reverb = mArena->create<revmodel> ();
+	limiter = mArena->create<SoftLimiter> ();
+	if (!mScratch || !smoother || !distortion || !reverb || !limiter ||
+		std::find (_voices.begin(), _voices.end(), (VoiceBoard *) NULL) != _voices.end()) {
+		destroyState ();
+		throw std::bad_alloc ();
 	}
 	
 	memset(&_keyPresses, 0, sizeof(_keyPresses));
+	memset(mParameters, 0, sizeof(mParameters));
+	memset(mPendingSet, 0, sizeof(mPendingSet));
+	memset((void *)mQueuedSet, 0, sizeof(mQueuedSet));
+	memset(mStageTime, 0, sizeof(mStageTime));
 
-	SetSampleRate (44100);
+	applySampleRate ();
 }
 
 VoiceAllocationUnit::~VoiceAllocationUnit	()
 {
-	while (_voices.size()) { delete _voices.back(); _voices.pop_back(); }
-	delete limiter;
-	delete reverb;
-	delete distortion;
-	delete [] mBuffer;
+	destroyState ();
+}
+
+void
+VoiceAllocationUnit::destroyState	()
+{
+	while (_voices.size()) { MemoryArena::destroy (_voices.back()); _voices.pop_back(); }
+	MemoryArena::destroy (limiter);
+	MemoryArena::destroy (reverb);
+	MemoryArena::destroy (distortion);
+	MemoryArena::destroy (smoother);
+	MemoryArena::destroy (mScratch);
+	delete mArena;
+}
+
+bool
+VoiceAllocationUnit::lockMemory	()
+{
+	return mArena->lock ();
 }
 
 void
 VoiceAllocationUnit::SetSampleRate	(int rate)
 {
+	mRequestedSampleRate = rate; // applied by Process()
+}
+
+void
+VoiceAllocationUnit::applySampleRate	()
+{
+	const int rate = mRequestedSampleRate;
+	if (rate == mSampleRate)
+		return;
+	mSampleRate = rate;
 	limiter->SetSampleRate (rate);
+	smoother->setSampleRate (rate);
 	for (unsigned i=0; i<_voices.size(); ++i) _voices[i]->SetSampleRate (rate);
 }
 
+void
+VoiceAllocationUnit::setBlockSize	(unsigned frames)
+{
+	mBlockSize = std::max(1u, std::min(frames, (unsigned) VoiceBoard::kMaxProcessBufferSize));
+}
+
+void
+VoiceAllocationUnit::SetMaxVoices	(int voices)
+{
+	mMaxVoices = voices;
+	mEffectiveMaxVoices = voices ? voices : _voices.size();
+}
+
+void
+VoiceAllocationUnit::setPolyphonyGovernor	(bool enabled)
+{
+	mGovernorEnabled = enabled;
+	mGovernorTime = 0;
+	mGovernorFrames = 0;
+	if (!enabled)
+		mEffectiveMaxVoices = mMaxVoices ? mMaxVoices : _voices.size();
+}
+
+void
+VoiceAllocationUnit::getStats	(Stats &stats) const
+{
+	stats.activeVoices = 0;
+	for (unsigned i = 0; i < _voices.size(); i++)
+		stats.activeVoices += (active[i] && !retiring[i]) ? 1 : 0;
+	stats.voicesStolen = mVoicesStolen + mVoicesShed;
+	stats.parameterChanges = mParameterChanges;
+	stats.frames = mFrames;
+	for (int i = 0; i < kMetricsStageCount; i++)
+		stats.stageTime[i] = mStageTime[i];
+}
+
+static inline unsigned long long
+nanoseconds ()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// adjusts mEffectiveMaxVoices, given that rendering frames took seconds
+void
+VoiceAllocationUnit::governPolyphony	(double seconds, unsigned frames)
+{
+	mGovernorTime += seconds;
+	mGovernorFrames += frames;
+	if (mGovernorFrames < kGovernorPeriod)
+		return;
+
+	const float load = (float) (mGovernorTime * mSampleRate / mGovernorFrames);
+	mGovernorTime = 0;
+	mGovernorFrames = 0;
+	mDspLoad = load;
+
+	unsigned voices = 0;
+	for (unsigned i = 0; i < _voices.size(); i++)
+		voices += (active[i] && !retiring[i]) ? 1 : 0;
+	if (voices)
+		mVoiceCost = mVoiceCost ? (0.9f * mVoiceCost + 0.1f * load / voices) : load / voices;
+
+	const unsigned maxVoices = mMaxVoices ? mMaxVoices : _voices.size();
+
+	if (load > kHighLoad && voices > 1 && mVoiceCost > 0) {
+		unsigned excess = (unsigned) ceilf((load - kTargetLoad) / mVoiceCost);
+		mEffectiveMaxVoices = voices > excess ? voices - excess : 1;
+		while (voices > mEffectiveMaxVoices) {
+			int idx = findVoiceToSteal();
+			if (idx < 0)
+				break;
+			retireVoice(idx);
+			voices--;
+			mVoicesShed++;
+		}
+	} else if (load < kLowLoad && mEffectiveMaxVoices < maxVoices) {
+		mEffectiveMaxVoices++;
+	}
+}
+
+// the voice to give up when there are too many, ignoring those already retiring
+int
+VoiceAllocationUnit::findVoiceToSteal()
+{
+	int idx = -1;
+	// strategy 1) find the oldest voice in release phase
+	unsigned keyPress = _keyPressCounter + 1;
+	for (int i=0; i<128; i++) {
+		if (active[i] && !retiring[i] && !keyPressed[i]) {
+			if (keyPress > _keyPresses[i]) {
+				keyPress = _keyPresses[i];
+				idx = i;
+			}
+		}
+	}
+	if (idx < 0) {
+		// strategy 2) find the oldest voice
+		keyPress = _keyPressCounter + 1;
+		for (int i=0; i<128; i++) {
+			if (active[i] && !retiring[i]) {
+				if (keyPress > _keyPresses[i]) {
+					keyPress = _keyPresses[i];
+					idx = i;
+				}
+			}
+		}
+	}
+	return idx;
+}
+
 void
 VoiceAllocationUnit::HandleMidiNoteOn(int note, float velocity)
 {
@@ -89,41 +309,30 @@ VoiceAllocationUnit::HandleMidiNoteOn(int note, float velocity)
 		return;
 	}
 	
+	// a note following a program change plays the new preset
+	applySampleRate();
+	applyPendingPreset();
+	applyQueuedParameters();
+
 	keyPressed[note] = true;
 	
 	if (_keyboardMode == KeyboardModePoly) {
 
-		if (mMaxVoices) {
-			unsigned count = 0;
-			for (int i=0; i<128; i++)
-				count = count + (active[i] ? 1 : 0);
-			if (count >= mMaxVoices) {
-				int idx = -1;
-				// strategy 1) find the oldest voice in release phase
-				unsigned keyPress = _keyPressCounter + 1;
-				for (int i=0; i<128; i++) {
-					if (active[i] && !keyPressed[i]) {
-						if (keyPress > _keyPresses[i]) {
-							keyPress = _keyPresses[i];
-							idx = i;
-						}
-					}
-				}
-				if (idx < 0) {
-					// strategy 2) find the oldest voice
-					keyPress = _keyPressCounter + 1;
-					for (int i=0; i<128; i++) {
-						if (active[i]) {
-							if (keyPress > _keyPresses[i]) {
-								keyPress = _keyPresses[i];
-								idx = i;
-							}
-						}
-					}
-				}
-				assert(0 <= idx && idx < 128);
-				active[idx] = false;
-			}
+		// mEffectiveMaxVoices is the polyphony setting, or lower while the governor is shedding load
+		unsigned count = 0;
+		for (int i=0; i<128; i++)
+			count = count + (active[i] ? 1 : 0);
+		if (count >= mEffectiveMaxVoices) {
+			// a voice already fading out is the cheapest to lose
+			int idx = -1;
+			for (int i=0; i<128 && idx < 0; i++)
+				if (active[i] && retiring[i])
+					idx = i;
+			if (idx < 0)
+				idx = findVoiceToSteal();
+			assert(0 <= idx && idx < 128);
+			active[idx] = false;
+			mVoicesStolen++;
 		}
 
 		_keyPresses[note] = (++_keyPressCounter);
@@ -134,6 +343,8 @@ VoiceAllocationUnit::HandleMidiNoteOn(int note, float velocity)
 			_voices[note]->setFrequency(pitch, pitch, 0);
 		}
 
+		if (retiring[note])
+			rejoinVoice(note);
 		if (_voices[note]->isSilent())
 			_voices[note]->reset();
 		
@@ -156,6 +367,9 @@ VoiceAllocationUnit::HandleMidiNoteOn(int note, float velocity)
 
 		_keyPresses[note] = (++_keyPressCounter);
 		
+		if (retiring[0])
+			rejoinVoice(0);
+
 		VoiceBoard *voice = _voices[0];
 		
 		voice->setVelocity(velocity);
@@ -266,6 +480,8 @@ VoiceAllocationUnit::resetAllVoices()
 		keyPressed[i] = false;
 		_keyPresses[i] = 0;
 		_voices[i]->reset();
+		if (retiring[i])
+			rejoinVoice(i);
 	}
 	_keyPressCounter = 0;
 	sustain = false;
@@ -274,41 +490,84 @@ VoiceAllocationUnit::resetAllVoices()
 void
 VoiceAllocationUnit::Process		(float *l, float *r, unsigned nframes, int stride)
 {
-	if (nframes > kBufferSize) {
-		this->Process(l,               r,                         kBufferSize, stride);
-		this->Process(l + kBufferSize, r + kBufferSize, nframes - kBufferSize, stride);
-		return;
-	}
+	Process (l, r, nframes, stride, *mScratch);
+}
+
+void
+VoiceAllocationUnit::Process		(float *l, float *r, unsigned nframes, int stride, Scratch &scratch)
+{
+	struct timespec start;
+	if (mGovernorEnabled)
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+	applySampleRate ();
+	applyPendingPreset ();
+	applyQueuedParameters ();
+	applyQuality ();
 
 	float pitchBendValue = mLastPitchBendValue;
 	float pitchBendValueEnd = mNextPitchBendValue;
 	float pitchBendValueInc = (pitchBendValueEnd - pitchBendValue) / nframes;
 
-	float* vb = mBuffer;
-	memset(vb, 0, nframes * sizeof (float));
+	float* vb = scratch.mix;
+	const unsigned blockSize = mBlockSize;
+	const bool timing = mStageTiming;
+	unsigned long long t0 = 0, t1 = 0, t2 = 0;
 
 	unsigned framesLeft = nframes, j = 0;
 	while (0 < framesLeft) {
-		int fr = std::min(framesLeft, (unsigned)VoiceBoard::kMaxProcessBufferSize);
+		int fr = std::min(framesLeft, blockSize);
+		memset(vb, 0, fr * sizeof (float));
+		if (timing) t0 = nanoseconds ();
+		Param changed[kAmsynthParameterCount];
+		for (unsigned n = smoother->process (fr, changed); n--;)
+			applyParameter (changed[n], smoother->getValue (changed[n]));
 		for (unsigned i=0; i<_voices.size(); i++) {
 			if (active[i]) {
 				if (_voices[i]->isSilent()) {
 					active[i] = false;
+					if (retiring[i])
+						rejoinVoice (i);
 				} else {
 					_voices[i]->SetPitchBend (pitchBendValue);
-					_voices[i]->ProcessSamplesMix (vb+j, fr, mMasterVol);
+					_voices[i]->ProcessSamplesMix (vb, fr, mMasterVol, scratch.voice);
 				}
 			}
 		}
+		if (timing) t1 = nanoseconds ();
+		// effects run per sub-block too, so they see their parameters' ramps
+		distortion->Process (vb, fr);
+		reverb->processreplace (vb, l+j*stride, r+j*stride, fr, 1, stride); // mono -> stereo
+		limiter->Process (l+j*stride, r+j*stride, fr, stride);
+		if (timing) {
+			t2 = nanoseconds ();
+			mStageTime[kMetricsStageVoices] += t1 - t0;
+			mStageTime[kMetricsStageEffects] += t2 - t1;
+		}
 		j += fr; framesLeft -= fr;
 		pitchBendValue = pitchBendValue + pitchBendValueInc * fr;
 	}
 
-	distortion->Process (vb, nframes);
-	reverb->processreplace (vb, l,r, nframes, 1, stride); // mono -> stereo
-	limiter->Process (l,r, nframes, stride);
-
 	mLastPitchBendValue = pitchBendValueEnd;
+	mFrames += nframes;
+
+	if (mGovernorEnabled) {
+		struct timespec end;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		governPolyphony((end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9, nframes);
+	}
+}
+
+void
+VoiceAllocationUnit::applyQuality	()
+{
+	const int quality = mRequestedQuality;
+	if (quality == mQuality)
+		return;
+	mQuality = quality;
+	for (unsigned i=0; i<_voices.size(); i++)
+		_voices[i]->setQuality ((Quality) quality);
+	reverb->setcombcount (quality == QualityEco ? kEcoReverbCombs : numcombs);
 }
 
 void
@@ -320,9 +579,170 @@ VoiceAllocationUnit::setKeyboardMode(KeyboardMode keyboardMode)
 	}
 }
 
+// continuous parameters which are ramped to avoid zipper noise
+static bool
+is_smoothed (Param param)
+{
+	switch (param)
+	{
+	case kAmsynthParameter_MasterVolume:
+	case kAmsynthParameter_ReverbWet:
+	case kAmsynthParameter_AmpDistortion:
+	case kAmsynthParameter_FilterCutoff:
+	case kAmsynthParameter_FilterResonance:
+	case kAmsynthParameter_FilterEnvAmount:
+	case kAmsynthParameter_OscillatorMix:
+	case kAmsynthParameter_OscillatorMixRingMod:
+	case kAmsynthParameter_Oscillator1Pulsewidth:
+	case kAmsynthParameter_Oscillator2Pulsewidth:
+	case kAmsynthParameter_Oscillator2Detune:
+	case kAmsynthParameter_LFOToOscillators:
+	case kAmsynthParameter_LFOToFilterCutoff:
+	case kAmsynthParameter_LFOToAmp:
+		return true;
+	default:
+		return false;
+	}
+}
+
 void
 VoiceAllocationUnit::UpdateParameter	(Param param, float value)
 {
+	mParameterChanges++;
+	if (mPresetChangeState == kPresetChangeWriting && pthread_equal(mPresetChangeWriter, pthread_self())) {
+		mPendingValues[param] = value;
+		mPendingSet[param] = true;
+		mQueuedSet[param] = 0; // superseded by the preset
+		return;
+	}
+	// the voices and effects are only touched by the audio thread, in applyQueuedParameters()
+	mQueuedValues[param] = value;
+	__sync_synchronize(); // publish the value before the flag
+	mQueuedSet[param] = 1;
+	mQueued = 1;
+}
+
+void
+VoiceAllocationUnit::BeginPresetChange	()
+{
+	// a change which hasn't been applied yet is added to
+	const int state = mPresetChangeState;
+	if ((state == kPresetChangeIdle || state == kPresetChangeReady) &&
+		__sync_bool_compare_and_swap(&mPresetChangeState, state, kPresetChangeWriting)) {
+		mPresetChangeWriter = pthread_self();
+		return;
+	}
+	// another thread is writing a change, or one is being applied. this may be
+	// the audio thread, so rather than wait the values go through the queue,
+	// and the next block applies them as a preset change
+	mPresetChangeMissed = 1;
+}
+
+void
+VoiceAllocationUnit::EndPresetChange	()
+{
+	if (mPresetChangeState != kPresetChangeWriting || !pthread_equal(mPresetChangeWriter, pthread_self()))
+		return;
+	mPresetChangeWriter = pthread_t();
+	__sync_synchronize(); // publish the values before the state
+	mPresetChangeState = kPresetChangeReady;
+}
+
+void
+VoiceAllocationUnit::applyPendingPreset	()
+{
+	if (mPresetChangeState != kPresetChangeReady ||
+		!__sync_bool_compare_and_swap(&mPresetChangeState, kPresetChangeReady, kPresetChangeApplying))
+		return;
+
+	// sounding voices fade out with the old preset instead of being cut off
+	for (unsigned i = 0; i < _voices.size(); i++)
+		if (active[i] && !retiring[i])
+			retireVoice(i);
+
+	for (int i = 0; i < kAmsynthParameterCount; i++) {
+		if (!mPendingSet[i])
+			continue;
+		mPendingSet[i] = false;
+		applyPresetParameter ((Param) i, mPendingValues[i]);
+	}
+
+	__sync_synchronize();
+	mPresetChangeState = kPresetChangeIdle;
+}
+
+void
+VoiceAllocationUnit::applyQueuedParameters	()
+{
+	if (!mQueued)
+		return;
+	mQueued = 0;
+	__sync_synchronize(); // values queued from now on are seen by the next call
+
+	const bool presetChange = __sync_lock_test_and_set(&mPresetChangeMissed, 0);
+	if (presetChange) {
+		for (unsigned i = 0; i < _voices.size(); i++)
+			if (active[i] && !retiring[i])
+				retireVoice(i);
+	}
+
+	for (int i = 0; i < kAmsynthParameterCount; i++) {
+		if (!mQueuedSet[i] || !__sync_lock_test_and_set(&mQueuedSet[i], 0))
+			continue;
+		__sync_synchronize();
+		const Param param = (Param) i;
+		const float value = mQueuedValues[i];
+		if (presetChange)
+			applyPresetParameter (param, value);
+		else if (is_smoothed (param))
+			smoother->setTarget (param, value); // applied by Process()
+		else
+			applyParameter (param, value);
+	}
+}
+
+void
+VoiceAllocationUnit::applyPresetParameter	(Param param, float value)
+{
+	switch (param) {
+	// these affect the voices which are fading out too
+	case kAmsynthParameter_MasterVolume:
+	case kAmsynthParameter_ReverbWet:
+	case kAmsynthParameter_AmpDistortion:
+		smoother->setTarget (param, value);
+		break;
+	// the rest only reach voices playing the new preset, so needn't be ramped
+	default:
+		if (is_smoothed (param))
+			smoother->reset (param, value);
+		applyParameter (param, value);
+		break;
+	}
+}
+
+// releases a voice quickly, after which rejoinVoice() restores its parameters
+void
+VoiceAllocationUnit::retireVoice		(unsigned voice)
+{
+	_voices[voice]->UpdateParameter(kAmsynthParameter_AmpEnvRelease, kRetireReleaseTime);
+	_voices[voice]->triggerOff();
+	retiring[voice] = true;
+}
+
+// gives a retired voice the current parameters again
+void
+VoiceAllocationUnit::rejoinVoice		(unsigned voice)
+{
+	retiring[voice] = false;
+	for (int i = 0; i < kAmsynthParameterCount; i++)
+		_voices[voice]->UpdateParameter ((Param) i, mParameters[i]);
+}
+
+void
+VoiceAllocationUnit::applyParameter	(Param param, float value)
+{
+	mParameters[param] = value;
+
 	switch (param)
 	{
 	case kAmsynthParameter_MasterVolume:		mMasterVol = value;		break;
@@ -334,7 +754,10 @@ VoiceAllocationUnit::UpdateParameter	(Param param, float value)
 	case kAmsynthParameter_PortamentoTime: 	mPortamentoTime = value; break;
 	case kAmsynthParameter_KeyboardMode:	setKeyboardMode((KeyboardMode)value); break;
 	
-	default: for (unsigned i=0; i<_voices.size(); i++) _voices[i]->UpdateParameter (param, value); break;
+	default:
+		for (unsigned i=0; i<_voices.size(); i++)
+			if (!retiring[i]) _voices[i]->UpdateParameter (param, value);
+		break;
 	}
 }
 
@@ -22,9 +22,11 @@
 #ifndef _VOICEALLOCATIONUNIT_H
 #define _VOICEALLOCATIONUNIT_H
 
+#include <pthread.h>
 #include <vector>
 
 #include "UpdateListener.h"
+#include "Metrics.h"
 #include "MidiController.h"
 #include "TuningMap.h"
 
@@ -32,16 +34,45 @@ class VoiceBoard;
 class SoftLimiter;
 class revmodel;
 class Distortion;
+class ParameterSmoother;
+class MemoryArena;
 
 class VoiceAllocationUnit : public UpdateListener, public MidiEventHandler
 {
 public:
-			VoiceAllocationUnit		();
+	// All of the synthesis state is allocated in one block of memory, from huge
+	// pages if hugePages is true and the system has some reserved.
+	// Throws std::bad_alloc if that memory can't be allocated.
+			VoiceAllocationUnit		(bool hugePages = false);
 	virtual	~VoiceAllocationUnit	();
 
+	// Locks the synthesis state into RAM, returns false if not permitted
+	bool	lockMemory		();
+
+	// May be called from any thread, the value is applied by the audio thread
+	// at the start of the next Process() or note on.
 	void	UpdateParameter		(Param, float);
 
+	// A new preset is applied at the start of the next Process() or note on,
+	// whichever comes first. Voices which are sounding are released quickly
+	// and keep the old preset until they are silent.
+	// Neither call ever waits, so they are safe on the audio thread.
+	void	BeginPresetChange	();
+	void	EndPresetChange		();
+
+	// May be called while another thread is running Process(), the new rate
+	// takes effect at the start of the next Process() or note on.
 	void	SetSampleRate		(int);
+
+	enum { kDefaultBlockSize = 64 };
+
+	// Process() renders in blocks of at most this many frames, up to
+	// VoiceBoard::kMaxProcessBufferSize. Modulation is updated once per block,
+	// so smaller blocks give smoother modulation at some cost in CPU time.
+	// May be called while the audio thread is running; the new size takes
+	// effect from the next call to Process().
+	void	setBlockSize		(unsigned frames);
+	unsigned	getBlockSize	() const { return mBlockSize; }
 	
 	virtual void HandleMidiNoteOn(int note, float velocity);
 	virtual void HandleMidiNoteOff(int note, float velocity);
@@ -51,30 +82,99 @@ public:
 	virtual void HandleMidiAllNotesOff();
 	virtual void HandleMidiSustainPedal(uchar value);
 
-	void	SetMaxVoices	(int voices) { mMaxVoices = voices; }
+	void	SetMaxVoices	(int voices);
 	int		GetMaxVoices	() { return mMaxVoices; }
 
+	// When enabled, Process() measures how long rendering takes compared to
+	// the duration of the audio, and lowers the voice limit below
+	// GetMaxVoices() while it is too close, releasing the oldest released (or
+	// else oldest) voices. Only useful when rendering in realtime.
+	void	setPolyphonyGovernor	(bool enabled);
+	unsigned	getEffectiveMaxVoices	() const { return mEffectiveMaxVoices; }
+	// render time / audio duration, as last measured by the governor
+	float	getDspLoad		() const { return mDspLoad; }
+	// voices released by the governor
+	unsigned long	getVoicesShed	() const { return mVoicesShed; }
+
+	// Counters for monitoring, see Metrics.h. Read them from the thread which
+	// calls Process(), or accept that they may be slightly out of date.
+	struct Stats
+	{
+		unsigned	activeVoices;
+		unsigned long	voicesStolen;		// including those shed by the governor
+		unsigned long	parameterChanges;
+		unsigned long long	frames;
+		unsigned long long	stageTime[kMetricsStageCount];	// nanoseconds
+	};
+	void	getStats		(Stats &) const;
+	// measures how long each stage of Process() takes, for Stats::stageTime
+	void	setStageTiming	(bool enabled) { mStageTiming = enabled; }
+
+	// May be called from any thread, takes effect at the next Process().
+	// QualityEco also thins out the reverb.
+	void	setQuality		(Quality quality) { mRequestedQuality = quality; }
+	Quality	getQuality		() const { return (Quality) mRequestedQuality; }
+
 	float	getPitchBendRangeSemitones() { return mPitchBendRangeSemitones; }
 	void	setPitchBendRangeSemitones(float range) { mPitchBendRangeSemitones = range; }
 	void	setKeyboardMode(KeyboardMode);
 
-	// processing with stride (interleaved) is not functional yet!!!
+	// Working memory for Process(). Units which are never processed concurrently
+	// may share one, see run_multiple_synths() in dssi.cpp
+	struct Scratch;
+	static Scratch *	createScratch	();
+	static void			destroyScratch	(Scratch *);
+
+	// Renders nframes into l and r, which are stride floats apart from one frame to
+	// the next. For interleaved stereo pass l = buffer, r = buffer + 1, stride = 2.
 	void	Process			(float *l, float *r, unsigned nframes, int stride=1);
+	void	Process			(float *l, float *r, unsigned nframes, int stride, Scratch &scratch);
 
 	double	noteToPitch		(int note) const;
 	int		loadScale		(const std::string & sclFileName);
 	int		loadKeyMap		(const std::string & kbmFileName);
 	void	defaultTuning	();
+	const TuningMap &	getTuningMap	() const { return tuningMap; }
+	void	setTuningMap	(const TuningMap &map) { tuningMap = map; }
 
 private:
 
 	void	resetAllVoices();
+	void	destroyState	();
+	void	applyParameter	(Param, float);
+	void	applySampleRate	();
+	void	applyPendingPreset	();
+	void	applyQueuedParameters	();
+	void	applyPresetParameter	(Param, float);
+	void	retireVoice		(unsigned voice);
+	void	rejoinVoice		(unsigned voice);
+	int		findVoiceToSteal	();
+	void	governPolyphony	(double seconds, unsigned frames);
+	void	applyQuality	();
 
 	int		mMaxVoices;
+	unsigned	mEffectiveMaxVoices;
+	bool	mGovernorEnabled;
+	double	mGovernorTime;
+	unsigned	mGovernorFrames;
+	float	mVoiceCost;		// average load added by each voice
+	float	mDspLoad;
+	unsigned long	mVoicesShed;
+	unsigned long	mVoicesStolen;
+	unsigned long	mParameterChanges;
+	unsigned long long	mFrames;
+	bool	mStageTiming;
+	unsigned long long	mStageTime[kMetricsStageCount];
+	volatile int	mRequestedSampleRate;
+	int		mSampleRate;
+	volatile int	mRequestedQuality;
+	int		mQuality;
+	unsigned	mBlockSize;
 
 	float	mPortamentoTime;
 	bool	keyPressed[128], sustain;
 	bool	active[128];
+	bool	retiring[128];	// releasing with the previous preset, see applyPendingPreset()
 	
 	unsigned	_keyboardMode;
 	unsigned	_keyPresses[128];
@@ -85,8 +185,20 @@ private:
 	SoftLimiter	*limiter;
 	revmodel	*reverb;
 	Distortion	*distortion;
+	ParameterSmoother	*smoother;
 	
-	float	*mBuffer;
+	Scratch	*mScratch;
+	MemoryArena	*mArena;
+
+	float	mParameters[kAmsynthParameterCount];	// the values last applied
+	float	mPendingValues[kAmsynthParameterCount];
+	bool	mPendingSet[kAmsynthParameterCount];
+	volatile int	mPresetChangeState;
+	volatile pthread_t	mPresetChangeWriter;	// the thread in kPresetChangeWriting
+	volatile int	mPresetChangeMissed;	// a change couldn't start, its values were queued
+	float	mQueuedValues[kAmsynthParameterCount];	// see UpdateParameter()
+	volatile int	mQueuedSet[kAmsynthParameterCount];
+	volatile int	mQueued;
 
 	float	mMasterVol;
 	float	mPitchBendRangeSemitones;
@@ -28,12 +28,11 @@
 static const float kMinimumTime = 0.0005;
 static const double kTc = 1.58197670686933; // e/(e-1)
 
-ADSR::ADSR(float * buffer)
+ADSR::ADSR()
 :	m_attack(0)
 ,	m_decay(0)
 ,	m_sustain(1)
 ,	m_release(0)
-,	m_buffer(buffer)
 ,	m_sample_rate(44100)
 ,	m_state(off)
 ,	m_value(0)
@@ -73,9 +72,9 @@ ADSR::reset()
 }
 
 float *
-ADSR::getNFData(unsigned int frames)
+ADSR::getNFData(float *output, unsigned int frames)
 {
-	float *buffer = m_buffer;
+	float *buffer = output;
 
 	while (frames) {
 
@@ -117,5 +116,5 @@ ADSR::getNFData(unsigned int frames)
 		frames -= count;
 	}
 
-	return m_buffer;
+	return output;
 }
@@ -27,7 +27,7 @@ class ADSR
 public:
 	enum ADSRState { attack, decay, sustain, release, off };
 
-	ADSR	(float *buffer);
+	ADSR	();
 	
 	void	SetSampleRate	(int value) { m_sample_rate = value; }
 
@@ -36,7 +36,8 @@ public:
 	void	SetSustain	(float value) { m_sustain = value; if (m_state == sustain) m_target = value; }
 	void	SetRelease	(float value) { m_release = value; }
 	
-	float * getNFData	(unsigned int frames);
+	// writes the next frames of the envelope to buffer, and returns buffer
+	float * getNFData	(float *buffer, unsigned int frames);
 	
 	void	triggerOn	();
 	void	triggerOff	();
@@ -55,7 +56,6 @@ private:
 	float       m_sustain;
 	float       m_release;
 
-	float *     m_buffer;
 	float       m_sample_rate;
 	ADSRState   m_state;
 
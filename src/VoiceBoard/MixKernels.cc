@@ -0,0 +1,169 @@
+/*
+ *  MixKernels.cc
+ *
+ *  Copyright (c) 2001-2012 Nick Dowell
+ *
+ *  This file is part of amsynth.
+ *
+ *  amsynth is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  amsynth is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with amsynth.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MixKernels.h"
+
+#include "../CpuFeatures.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+// The loops are written once for each vector width. The expressions must be
+// evaluated in the same order as in the generic versions, so that switching
+// variants doesn't change the output.
+
+static void
+mix_oscillators_generic (float *a, const float *b, int count, float avol, float bvol, float ring)
+{
+	for (int i=0; i<count; i++)
+		a[i] = avol * a[i] + bvol * b[i] + ring * a[i] * b[i];
+}
+
+static void
+vca_amplitude_generic (float *env, const float *lfo, int count, float velocity, float lfoamount)
+{
+	for (int i=0; i<count; i++)
+		env[i] = env[i] * velocity * (((lfo[i] * 0.5f) + 0.5f) * lfoamount + 1 - lfoamount);
+}
+
+static void
+mix_gain_generic (float *dst, const float *src, int count, float gain)
+{
+	for (int i=0; i<count; i++)
+		dst[i] += src[i] * gain;
+}
+
+#define DEFINE_VECTOR_KERNELS(ISA, ATTRIBUTES, VEC, PFX, WIDTH, LEAVE) \
+\
+ATTRIBUTES static void \
+mix_oscillators_##ISA (float *a, const float *b, int count, float avol, float bvol, float ring) \
+{ \
+	const VEC av = PFX##_set1_ps (avol), bv = PFX##_set1_ps (bvol), rv = PFX##_set1_ps (ring); \
+	int i = 0; \
+	for (; i + WIDTH <= count; i += WIDTH) { \
+		VEC x = PFX##_loadu_ps (a + i), y = PFX##_loadu_ps (b + i); \
+		VEC sum = PFX##_add_ps (PFX##_mul_ps (av, x), PFX##_mul_ps (bv, y)); \
+		PFX##_storeu_ps (a + i, PFX##_add_ps (sum, PFX##_mul_ps (PFX##_mul_ps (rv, x), y))); \
+	} \
+	LEAVE; \
+	mix_oscillators_generic (a + i, b + i, count - i, avol, bvol, ring); \
+} \
+\
+ATTRIBUTES static void \
+vca_amplitude_##ISA (float *env, const float *lfo, int count, float velocity, float lfoamount) \
+{ \
+	const VEC vel = PFX##_set1_ps (velocity), amount = PFX##_set1_ps (lfoamount); \
+	const VEC half = PFX##_set1_ps (0.5f), one = PFX##_set1_ps (1.0f); \
+	int i = 0; \
+	for (; i + WIDTH <= count; i += WIDTH) { \
+		VEC mod = PFX##_add_ps (PFX##_mul_ps (PFX##_loadu_ps (lfo + i), half), half); \
+		mod = PFX##_sub_ps (PFX##_add_ps (PFX##_mul_ps (mod, amount), one), amount); \
+		PFX##_storeu_ps (env + i, PFX##_mul_ps (PFX##_mul_ps (PFX##_loadu_ps (env + i), vel), mod)); \
+	} \
+	LEAVE; \
+	vca_amplitude_generic (env + i, lfo + i, count - i, velocity, lfoamount); \
+} \
+\
+ATTRIBUTES static void \
+mix_gain_##ISA (float *dst, const float *src, int count, float gain) \
+{ \
+	const VEC g = PFX##_set1_ps (gain); \
+	int i = 0; \
+	for (; i + WIDTH <= count; i += WIDTH) \
+		PFX##_storeu_ps (dst + i, PFX##_add_ps (PFX##_loadu_ps (dst + i), PFX##_mul_ps (PFX##_loadu_ps (src + i), g))); \
+	LEAVE; \
+	mix_gain_generic (dst + i, src + i, count - i, gain); \
+}
+
+#ifdef __SSE2__
+DEFINE_VECTOR_KERNELS(sse2, , __m128, _mm, 4, (void) 0)
+#endif
+
+#ifdef X86_DISPATCH
+// Without vzeroupper, SSE code after these (the rest of the voice) runs several
+// times slower, and GCC only inserts it by itself at -O2 and above.
+DEFINE_VECTOR_KERNELS(avx2, __attribute__((target("avx2"))), __m256, _mm256, 8, _mm256_zeroupper ())
+DEFINE_VECTOR_KERNELS(avx512f, __attribute__((target("avx512f"))), __m512, _mm512, 16, _mm256_zeroupper ())
+#endif
+
+struct MixKernels
+{
+	void (*mix_oscillators) (float *, const float *, int, float, float, float);
+	void (*vca_amplitude) (float *, const float *, int, float, float);
+	void (*mix_gain) (float *, const float *, int, float);
+	unsigned isa;
+};
+
+#define MIX_KERNELS(ISA, FEATURE) { mix_oscillators_##ISA, vca_amplitude_##ISA, mix_gain_##ISA, FEATURE }
+
+static MixKernels
+select_kernels ()
+{
+	const unsigned features = cpu_features ();
+#ifdef X86_DISPATCH
+	if (features & kCpuAVX512F) {
+		MixKernels k = MIX_KERNELS(avx512f, kCpuAVX512F); return k;
+	}
+	if (features & kCpuAVX2) {
+		MixKernels k = MIX_KERNELS(avx2, kCpuAVX2); return k;
+	}
+#endif
+#ifdef __SSE2__
+	if (features & kCpuSSE2) {
+		MixKernels k = MIX_KERNELS(sse2, kCpuSSE2); return k;
+	}
+#endif
+	MixKernels k = MIX_KERNELS(generic, 0);
+	return k;
+}
+
+static const MixKernels &
+kernels ()
+{
+	static const MixKernels k = select_kernels ();
+	return k;
+}
+
+void
+mix_oscillators (float *a, const float *b, int count, float avol, float bvol, float ring)
+{
+	kernels().mix_oscillators (a, b, count, avol, bvol, ring);
+}
+
+void
+vca_amplitude (float *env, const float *lfo, int count, float velocity, float lfoamount)
+{
+	kernels().vca_amplitude (env, lfo, count, velocity, lfoamount);
+}
+
+void
+mix_gain (float *dst, const float *src, int count, float gain)
+{
+	kernels().mix_gain (dst, src, count, gain);
+}
+
+const char *
+mix_kernels_isa ()
+{
+	return cpu_feature_name (kernels().isa);
+}
@@ -0,0 +1,41 @@
+/*
+ *  MixKernels.h
+ *
+ *  Copyright (c) 2001-2012 Nick Dowell
+ *
+ *  This file is part of amsynth.
+ *
+ *  amsynth is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  amsynth is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with amsynth.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _MIX_KERNELS_H
+#define _MIX_KERNELS_H
+
+// VoiceBoard's per-sample loops which have no feedback, and so can use vector
+// instructions. Each has a variant for every instruction set in CpuFeatures.h,
+// chosen for the CPU on first use. The variants give identical results.
+
+// a[i] = avol * a[i] + bvol * b[i] + ring * a[i] * b[i]
+void	mix_oscillators	(float *a, const float *b, int count, float avol, float bvol, float ring);
+
+// env[i] = env[i] * velocity * ((lfo[i] * 0.5 + 0.5) * lfoamount + 1 - lfoamount)
+void	vca_amplitude	(float *env, const float *lfo, int count, float velocity, float lfoamount);
+
+// dst[i] += src[i] * gain
+void	mix_gain		(float *dst, const float *src, int count, float gain);
+
+// the instruction set of the variants in use, e.g. "avx2"
+const char *	mix_kernels_isa	();
+
+#endif
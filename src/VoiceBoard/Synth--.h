@@ -130,4 +130,54 @@ struct IIRFilterFirstOrder
 	float _a0, _a1, _b1, _z;
 };
 
+// Halves the sample rate of a signal, after low-pass filtering it with an 8th
+// order butterworth filter. The cutoff is at 0.4 of the new sample rate, so
+// that what would alias into the audible band is attenuated by 44dB or more.
+class Decimator
+{
+public:
+
+	Decimator()
+	{
+		static const double q[kSections] = { 0.50979558, 0.60134489, 0.89997622, 2.56291545 };
+		const double k = tan(PI * 0.2), k2 = k * k;
+		for (int s = 0; s < kSections; s++) {
+			const double bh = 1.0 + k / q[s] + k2;
+			_a0[s] = (float) (k2 / bh);
+			_b1[s] = (float) (2.0 * (k2 - 1.0) / bh);
+			_b2[s] = (float) ((1.0 - k / q[s] + k2) / bh);
+		}
+		reset();
+	}
+
+	void reset()
+	{
+		for (int s = 0; s < kSections; s++)
+			_d1[s] = _d2[s] = 0.0f;
+	}
+
+	// reads 2 * numOutputSamples samples from buffer and writes numOutputSamples
+	// back to the start of it
+	void process(float *buffer, int numOutputSamples)
+	{
+		for (int i = 0; i < numOutputSamples * 2; i++) {
+			float y = buffer[i];
+			for (int s = 0; s < kSections; s++) {
+				const float x = y;
+				y       =        (_a0[s] * x) + _d1[s];
+				_d1[s] = _d2[s] + (_a0[s] * 2.0f * x) - (_b1[s] * y);
+				_d2[s] =         (_a0[s] * x) - (_b2[s] * y);
+			}
+			if (i & 1) buffer[i / 2] = y;
+		}
+	}
+
+private:
+
+	enum { kSections = 4 }; // biquads
+
+	float _a0[kSections], _b1[kSections], _b2[kSections];
+	float _d1[kSections], _d2[kSections];
+};
+
 #endif
@@ -20,6 +20,7 @@
  */
 
 #include "VoiceBoard.h"
+#include "MixKernels.h"
 
 #include <cassert>
 #include <cmath>
@@ -32,6 +33,8 @@ VoiceBoard::VoiceBoard()
 ,	mFrequencyStart (0.0)
 ,	mFrequencyTarget(0.0)
 ,	mFrequencyTime	(0.0)
+,	mSampleRate		(44100)
+,	mQuality		(QualityStandard)
 ,	mKeyVelocity	(1.0)
 ,	mPitchBend		(1.0)
 ,	mLFO1Freq		(0.0)
@@ -47,9 +50,7 @@ VoiceBoard::VoiceBoard()
 ,	mFilterModAmt	(0.0)
 ,	mFilterCutoff	(16.0)
 ,	mFilterRes		(0.0)
-,	filter_env		(mProcessBuffers.filter_env)
 ,	mAmpModAmount	(0.0)
-,	amp_env			(mProcessBuffers.amp_env)
 {
 }
 
@@ -119,7 +120,7 @@ VoiceBoard::SetPitchBend	(float val)
 }
 
 void
-VoiceBoard::ProcessSamplesMix	(float *buffer, int numSamples, float vol)
+VoiceBoard::ProcessSamplesMix	(float *buffer, int numSamples, float vol, ProcessBuffers &buffers)
 {
 	assert(numSamples <= kMaxProcessBufferSize);
 
@@ -131,8 +132,14 @@ VoiceBoard::ProcessSamplesMix	(float *buffer, int numSamples, float vol)
 	//
 	// Control Signals
 	//
-	float *lfo1buf = mProcessBuffers.lfo_osc_1;
-	lfo1.ProcessSamples (lfo1buf, numSamples, mLFO1Freq, mLFOPulseWidth);
+	float *lfo1buf = buffers.lfo_osc_1;
+	if (mQuality == QualityEco) {
+		// one LFO step covering the whole block
+		lfo1.ProcessSamples (lfo1buf, 1, mLFO1Freq * numSamples, mLFOPulseWidth);
+		for (int i=1; i<numSamples; i++) lfo1buf[i] = lfo1buf[0];
+	} else {
+		lfo1.ProcessSamples (lfo1buf, numSamples, mLFO1Freq, mLFOPulseWidth);
+	}
 
 	const float frequency = mFrequency.nextValue();
 	for (int i=1; i<numSamples; i++) { mFrequency.nextValue(); }
@@ -143,7 +150,7 @@ VoiceBoard::ProcessSamplesMix	(float *buffer, int numSamples, float vol)
 	float osc2freq = osc1freq * mOsc2Detune * mOsc2Octave * mOsc2Pitch;
 	float osc2pw = mOsc2PulseWidth;
 
-	float env_f = *filter_env.getNFData (numSamples);
+	float env_f = *filter_env.getNFData (buffers.filter_env, numSamples);
 	float cutoff = ( frequency * mKeyVelocity * mFilterCutoff ) * ( (lfo1buf[0]*0.5f + 0.5f) * mFilterModAmt + 1-mFilterModAmt );
 	if (mFilterEnvAmt > 0.f) cutoff += (frequency * env_f * mFilterEnvAmt);
 	else
@@ -156,10 +163,11 @@ VoiceBoard::ProcessSamplesMix	(float *buffer, int numSamples, float vol)
 	//
 	// VCOs
 	//
-	float *osc1buf = mProcessBuffers.osc_1;
-	float *osc2buf = mProcessBuffers.osc_2;
-	osc1.ProcessSamples (osc1buf, numSamples, osc1freq, osc1pw);
-	osc2.ProcessSamples (osc2buf, numSamples, osc2freq, osc2pw);
+	const int numOscSamples = numSamples * oversampling();
+	float *osc1buf = buffers.osc_1;
+	float *osc2buf = buffers.osc_2;
+	osc1.ProcessSamples (osc1buf, numOscSamples, osc1freq, osc1pw);
+	osc2.ProcessSamples (osc2buf, numOscSamples, osc2freq, osc2pw);
 
 	//
 	// Osc Mix
@@ -167,31 +175,29 @@ VoiceBoard::ProcessSamplesMix	(float *buffer, int numSamples, float vol)
 	float osc1vol = mOsc1Vol;
 	float osc2vol = mOsc2Vol;
 	if (mRingModAmt == 1.0) osc1vol = osc2vol = 0.0;
-	for (int i=0; i<numSamples; i++)
-		osc1buf[i] =
-			osc1vol * osc1buf[i] +
-			osc2vol * osc2buf[i] +
-			mRingModAmt * osc1buf[i]*osc2buf[i];
+	mix_oscillators (osc1buf, osc2buf, numOscSamples, osc1vol, osc2vol, mRingModAmt);
 
 	//
 	// VCF
 	//
-	filter.ProcessSamples (osc1buf, numSamples, cutoff, mFilterRes, mFilterType, mFilterSlope);
+	SynthFilter::FilterSlope slope = mQuality == QualityEco ? SynthFilter::FilterSlope12 : mFilterSlope;
+	filter.ProcessSamples (osc1buf, numOscSamples, cutoff, mFilterRes, mFilterType, slope);
+
+	if (mQuality == QualityHigh)
+		decimator.process (osc1buf, numSamples);
 	
 	//
 	// VCA
 	// 
-	float *ampenvbuf = amp_env.getNFData (numSamples);
-	for (int i=0; i<numSamples; i++) {
-		const float amplitude = ampenvbuf[i] * mKeyVelocity * 
-			( ((lfo1buf[i] * 0.5f) + 0.5f) * mAmpModAmount + 1 - mAmpModAmount);
-		osc1buf[i] = osc1buf[i] * _vcaFilter.processSample(amplitude);
-	}
+	float *ampenvbuf = amp_env.getNFData (buffers.amp_env, numSamples);
+	vca_amplitude (ampenvbuf, lfo1buf, numSamples, mKeyVelocity, mAmpModAmount);
+	for (int i=0; i<numSamples; i++)
+		osc1buf[i] = osc1buf[i] * _vcaFilter.processSample(ampenvbuf[i]);
 
 	//
 	// Copy, with overall volume
 	//
-	for (int i=0; i<numSamples; i++) buffer[i] += (osc1buf[i] * vol);
+	mix_gain (buffer, osc1buf, numSamples, vol);
 }
 
 void
@@ -199,14 +205,27 @@ VoiceBoard::SetSampleRate	(int rate)
 {
 	mSampleRate = rate;
 	lfo1.SetSampleRate (rate);
-	osc1.SetSampleRate (rate);
-	osc2.SetSampleRate (rate);
-	filter.SetSampleRate (rate);
+	osc1.SetSampleRate (rate * oversampling());
+	osc2.SetSampleRate (rate * oversampling());
+	filter.SetSampleRate (rate * oversampling());
 	filter_env.SetSampleRate (rate);
 	amp_env.SetSampleRate (rate);
 	_vcaFilter.setCoefficients(rate, kVCALowPassFreq, IIRFilterFirstOrder::LowPass);
 }
 
+void
+VoiceBoard::setQuality		(Quality quality)
+{
+	if (quality == mQuality)
+		return;
+	mQuality = quality;
+	const int rate = (int) mSampleRate * oversampling();
+	osc1.SetSampleRate (rate);
+	osc2.SetSampleRate (rate);
+	filter.SetSampleRate (rate);
+	decimator.reset();
+}
+
 bool 
 VoiceBoard::isSilent()
 {
@@ -235,6 +254,7 @@ VoiceBoard::reset()
 	osc1.reset();
 	osc2.reset();
 	filter.reset();
+	decimator.reset();
 	lfo1.reset();
 }
 
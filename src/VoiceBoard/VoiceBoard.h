@@ -40,7 +40,7 @@ class VoiceBoard
 public:
 
 	enum {
-		kMaxProcessBufferSize = 64,
+		kMaxProcessBufferSize = 256, // the largest block size, see VoiceAllocationUnit::setBlockSize()
 	};
 
 	VoiceBoard();
@@ -58,12 +58,28 @@ public:
 
 	void	UpdateParameter		(Param, float);
 
-	void	ProcessSamplesMix	(float *buffer, int numSamples, float vol);
+	// working memory for ProcessSamplesMix(), which any number of voices
+	// may share as long as they are not processed concurrently
+	struct ProcessBuffers {
+		float osc_1[kMaxProcessBufferSize * 2]; // oversampled at QualityHigh
+		float osc_2[kMaxProcessBufferSize * 2];
+		float lfo_osc_1[kMaxProcessBufferSize];
+		float filter_env[kMaxProcessBufferSize];
+		float amp_env[kMaxProcessBufferSize];
+	};
+
+	void	ProcessSamplesMix	(float *buffer, int numSamples, float vol, ProcessBuffers &buffers);
 
 	void	SetSampleRate		(int);
 
+	// QualityEco updates modulation once per call and uses 12dB filters,
+	// QualityHigh runs the oscillators and filter at twice the sample rate
+	void	setQuality			(Quality);
+
 private:
 
+	int		oversampling	() const { return mQuality == QualityHigh ? 2 : 1; }
+
 	Lerper			mFrequency;
 	bool			mFrequencyDirty;
 	float			mFrequencyStart;
@@ -71,6 +87,7 @@ private:
 	float			mFrequencyTime;
 
 	float			mSampleRate;
+	Quality			mQuality;
 	float			mKeyVelocity;
 	float			mPitchBend;
 	
@@ -102,17 +119,10 @@ private:
 	ADSR 			filter_env;
 	
 	// amp section
+	Decimator		decimator;
 	IIRFilterFirstOrder _vcaFilter;
 	float			mAmpModAmount;
 	ADSR 			amp_env;
-
-	struct {
-		float osc_1[kMaxProcessBufferSize];
-		float osc_2[kMaxProcessBufferSize];
-		float lfo_osc_1[kMaxProcessBufferSize];
-		float filter_env[kMaxProcessBufferSize];
-		float amp_env[kMaxProcessBufferSize];
-	} mProcessBuffers;
 };
 
 #endif
@@ -19,12 +19,17 @@
  *  along with amsynth.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "amsynth_lv2.h"
+#include "BankLoader.h"
 #include "controls.h"
 #include "midi.h"
 #include "MidiController.h"
 #include "PresetController.h"
+#include "UpdateListener.h"
 #include "VoiceAllocationUnit.h"
+#include "Effects/denormals.h"
 
+#include "lv2/lv2plug.in/ns/ext/atom/forge.h"
 #include "lv2/lv2plug.in/ns/ext/atom/util.h"
 #include "lv2/lv2plug.in/ns/ext/state/state.h"
 #include "lv2/lv2plug.in/ns/ext/urid/urid.h"
@@ -33,11 +38,14 @@
 #include "lv2/lv2plug.in/ns/lv2core/lv2.h"
 
 #include <assert.h>
+#include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <new>
 
-#define AMSYNTH_LV2_URI			"http://code.google.com/p/amsynth/amsynth"
+#define AMSYNTH_LV2_STATE_URI	AMSYNTH_LV2_URI "#state"
 
 #define LOG_ERROR(msg)			fprintf(stderr, AMSYNTH_LV2_URI " error: " msg "\n")
 #ifdef DEBUG
@@ -46,6 +54,44 @@
 #define LOG_FUNCTION_CALL()
 #endif
 
+// Records which parameters of the current preset have changed, eg. from a MIDI CC or a
+// program change, so lv2_run() only reports those on the control output port.
+class ParameterChangeTracker : public UpdateListener
+{
+public:
+	ParameterChangeTracker() : mModified(false) { memset(mDirty, 0, sizeof(mDirty)); }
+
+	virtual void UpdateParameter(Param param, float)
+	{
+		if (param < kAmsynthParameterCount)
+			mDirty[param / 32] |= 1u << (param % 32);
+		mModified = true;
+	}
+
+	// true if any parameter has changed since the last call
+	bool takeModified() { bool modified = mModified; mModified = false; return modified; }
+
+	void clear(int param) { mDirty[param / 32] &= ~(1u << (param % 32)); }
+
+	// returns the lowest changed parameter at or above first, or -1
+	int next(int first) const
+	{
+		for (int word = first / 32; word < kWords; word++) {
+			uint32_t bits = mDirty[word];
+			if (word == first / 32)
+				bits &= ~0u << (first % 32);
+			if (bits)
+				return word * 32 + __builtin_ctz(bits);
+		}
+		return -1;
+	}
+
+private:
+	static const int kWords = (kAmsynthParameterCount + 31) / 32;
+	uint32_t mDirty[kWords];
+	bool mModified;
+};
+
 struct amsynth_wrapper {
 	const char *bundle_path;
 	VoiceAllocationUnit *vau;
@@ -54,22 +100,74 @@ struct amsynth_wrapper {
 	float * out_l;
 	float * out_r;
 	const LV2_Atom_Sequence *midi_in_port;
+	LV2_Atom_Sequence *control_out_port;
+	const float *quality_port;
 	float ** params;
+	float port_values[kAmsynthParameterCount];	// last value seen on each parameter port
+	ParameterChangeTracker *changes;
+	LV2_Atom_Forge forge;
 	struct {
 		LV2_URID midiEvent;
+		LV2_URID patch_Set;
+		LV2_URID patch_property;
+		LV2_URID patch_value;
+		LV2_URID parameters[kAmsynthParameterCount];
+		LV2_URID atom_Chunk;
+		LV2_URID amsynth_state;
 	} uris;
+	LV2_Worker_Schedule *schedule;
+	std::string *bank_file;			// written by restore(), read by the worker
+	pthread_mutex_t bank_file_mutex;
+	bool bank_load_pending;
+	bool bank_load_in_flight;
+	volatile int bank_load_lost;	// set by work() if its response couldn't be sent
+	bool state_restored;			// the current preset came from restore(), not the bank
+	bool port_values_restored;		// lv2_run() takes the host's port values as they are, without applying them
+	PresetController *spent_bank;	// old presets, to be freed by the worker
+	MidiDecoder midi_decoder;		// zeroed by calloc() is the reset state
+	// copy of the current preset for save(), which may be called during lv2_run()
+	struct {
+		volatile unsigned sequence;	// odd while being written
+		float values[kAmsynthParameterCount];
+		char name[64];
+	} snapshot;
 };
 
+// messages sent to the worker thread
+struct amsynth_work {
+	enum { kLoadBank, kFreeBank } type;
+	PresetController *bank;
+};
+
+// called by the audio thread whenever the current preset may have changed
+static void
+update_snapshot(amsynth_wrapper *a)
+{
+	const Preset &preset = a->bank->getCurrentPreset();
+	if (!a->changes->takeModified() &&
+		!strncmp(a->snapshot.name, preset.getName().c_str(), sizeof(a->snapshot.name) - 1))
+		return;
+	__sync_fetch_and_add(&a->snapshot.sequence, 1);
+	for (int i = 0; i < kAmsynthParameterCount; i++)
+		a->snapshot.values[i] = preset.getValue(i);
+	strncpy(a->snapshot.name, preset.getName().c_str(), sizeof(a->snapshot.name) - 1);
+	__sync_fetch_and_add(&a->snapshot.sequence, 1);
+}
+
 static LV2_Handle
 lv2_instantiate(const struct _LV2_Descriptor *descriptor, double sample_rate, const char *bundle_path, const LV2_Feature *const *features)
 {
 	LOG_FUNCTION_CALL();
 
 	LV2_URID_Map *urid_map = NULL;
+	LV2_Worker_Schedule *schedule = NULL;
 	for (int i = 0; features[i]; ++i) {
 		if (!strcmp(features[i]->URI, LV2_URID__map)) {
 			urid_map = (LV2_URID_Map *)features[i]->data;
 		}
+		if (!strcmp(features[i]->URI, LV2_WORKER__schedule)) {
+			schedule = (LV2_Worker_Schedule *)features[i]->data;
+		}
 	}
 	if (urid_map == NULL) {
 		LOG_ERROR("host does not support " LV2_URID__map);
@@ -81,21 +179,57 @@ lv2_instantiate(const struct _LV2_Descriptor *descriptor, double sample_rate, co
 	config.load();
 	Preset amsynth_preset;
 
+	// exceptions mustn't propagate into the host
+	VoiceAllocationUnit *vau = NULL;
+	try {
+		vau = new VoiceAllocationUnit (config.huge_pages != 0);
+	} catch (std::bad_alloc &) {
+		LOG_ERROR("could not allocate the synthesis state");
+		return NULL;
+	}
+
 	amsynth_wrapper *a = (amsynth_wrapper *)calloc(1, sizeof(amsynth_wrapper));
 	a->bundle_path = strdup(bundle_path);
-	a->vau = new VoiceAllocationUnit;
+	a->vau = vau;
+	a->vau->lockMemory ();
 	a->vau->SetSampleRate (sample_rate);
 	a->vau->setPitchBendRangeSemitones (config.pitch_bend_range);
+	a->vau->setQuality (quality_from_name (config.quality.c_str()));
+	a->vau->setBlockSize (config.block_size);
 	a->bank = new PresetController;
-	a->bank->loadPresets(config.current_bank_file.c_str());
-	a->bank->selectPreset(0);
 	a->bank->getCurrentPreset().AddListenerToAll (a->vau);
+	a->schedule = schedule;
+	a->bank_file = new std::string(config.current_bank_file);
+	pthread_mutex_init(&a->bank_file_mutex, NULL);
+	if (schedule) {
+		// the bank is loaded by the worker, see lv2_run()
+		a->bank_load_pending = true;
+	} else {
+		a->bank->loadPresets(a->bank_file->c_str());
+		a->bank->readAllPresets(); // program changes select presets in lv2_run()
+		a->bank->selectPreset(0);
+	}
 	a->mc = new MidiController(config);
 	a->mc->SetMidiEventHandler(a->vau);
 	a->mc->setPresetController(*a->bank);
 	a->mc->set_midi_channel(0);
 	a->params = (float **) calloc (kAmsynthParameterCount, sizeof (float *));
+	for (int i = 0; i < kAmsynthParameterCount; i++)
+		a->port_values[i] = NAN; // forces every connected port to be applied in the first lv2_run()
+	a->changes = new ParameterChangeTracker;
+	a->bank->getCurrentPreset().AddListenerToAll (a->changes);
+	lv2_atom_forge_init(&a->forge, urid_map);
 	a->uris.midiEvent       = urid_map->map(urid_map->handle, LV2_MIDI__MidiEvent);
+	a->uris.patch_Set       = urid_map->map(urid_map->handle, LV2_PATCH__Set);
+	a->uris.patch_property  = urid_map->map(urid_map->handle, LV2_PATCH__property);
+	a->uris.patch_value     = urid_map->map(urid_map->handle, LV2_PATCH__value);
+	for (int i = 0; i < kAmsynthParameterCount; i++) {
+		std::string uri = std::string(AMSYNTH_LV2_PARAMETER_URI_PREFIX) + parameter_name_from_index(i);
+		a->uris.parameters[i] = urid_map->map(urid_map->handle, uri.c_str());
+	}
+	a->uris.atom_Chunk      = urid_map->map(urid_map->handle, LV2_ATOM__Chunk);
+	a->uris.amsynth_state   = urid_map->map(urid_map->handle, AMSYNTH_LV2_STATE_URI);
+	update_snapshot(a);
 
 	return (LV2_Handle) a;
 }
@@ -109,6 +243,10 @@ lv2_cleanup(LV2_Handle instance)
 	free ((void *)a->bundle_path);
 	delete a->vau;
 	delete a->bank;
+	delete a->spent_bank;
+	delete a->changes;
+	delete a->bank_file;
+	pthread_mutex_destroy(&a->bank_file_mutex);
 	free (a->params);
 	free ((void *)a);
 }
@@ -118,11 +256,15 @@ lv2_connect_port(LV2_Handle instance, uint32_t port, void *data_location)
 {
 	amsynth_wrapper * a = (amsynth_wrapper *) instance;
 	switch (port) {
-	case 0: a->out_l = (float *)data_location; break;
-	case 1: a->out_r = (float *)data_location; break;
-	case 2: a->midi_in_port = (LV2_Atom_Sequence *)data_location; break;
+	case kAmsynthLV2PortOutL: a->out_l = (float *)data_location; break;
+	case kAmsynthLV2PortOutR: a->out_r = (float *)data_location; break;
+	case kAmsynthLV2PortMidiIn: a->midi_in_port = (LV2_Atom_Sequence *)data_location; break;
+	case kAmsynthLV2PortControlOut: a->control_out_port = (LV2_Atom_Sequence *)data_location; break;
+	case kAmsynthLV2PortQuality: a->quality_port = (const float *)data_location; break;
 	default:
-		if ((port - 3) < kAmsynthParameterCount) { a->params[port-3] = (float *)data_location; }
+		if ((port - kAmsynthLV2PortFirstParameter) < kAmsynthParameterCount) {
+			a->params[port - kAmsynthLV2PortFirstParameter] = (float *)data_location;
+		}
 		break;
 	}
 }
@@ -139,41 +281,288 @@ lv2_deactivate(LV2_Handle instance)
 	LOG_FUNCTION_CALL();
 }
 
+// size of one patch:Set event as written by write_parameter_changes()
+static const uint32_t kPatchSetEventSize =
+	sizeof(int64_t) +							// frame time
+	sizeof(LV2_Atom_Object) +					// object header
+	2 * sizeof(uint32_t) + lv2_atom_pad_size(sizeof(LV2_Atom_URID)) +	// patch:property
+	2 * sizeof(uint32_t) + lv2_atom_pad_size(sizeof(LV2_Atom_Float));	// patch:value
+
+// reports parameters changed by the plugin itself as patch:Set messages on the control output
+static void
+write_parameter_changes(amsynth_wrapper *a)
+{
+	if (!a->control_out_port)
+		return;
+
+	const Preset &preset = a->bank->getCurrentPreset();
+	const uint32_t capacity = a->control_out_port->atom.size;
+	LV2_Atom_Forge_Frame sequence_frame;
+	lv2_atom_forge_set_buffer(&a->forge, (uint8_t *)a->control_out_port, capacity);
+	lv2_atom_forge_sequence_head(&a->forge, &sequence_frame, 0);
+
+	for (int i = a->changes->next(0); i != -1; i = a->changes->next(i + 1)) {
+		// whatever doesn't fit is sent in the next block
+		if (a->forge.offset + kPatchSetEventSize > a->forge.size)
+			break;
+		LV2_Atom_Forge_Frame frame;
+		lv2_atom_forge_frame_time(&a->forge, 0);
+		lv2_atom_forge_blank(&a->forge, &frame, 0, a->uris.patch_Set);
+		lv2_atom_forge_property_head(&a->forge, a->uris.patch_property, 0);
+		lv2_atom_forge_urid(&a->forge, a->uris.parameters[i]);
+		lv2_atom_forge_property_head(&a->forge, a->uris.patch_value, 0);
+		lv2_atom_forge_float(&a->forge, preset.getValue(i));
+		lv2_atom_forge_pop(&a->forge, &frame);
+		a->changes->clear(i);
+	}
+
+	lv2_atom_forge_pop(&a->forge, &sequence_frame);
+}
+
 static void
 lv2_run(LV2_Handle instance, uint32_t sample_count)
 {
 	amsynth_wrapper * a = (amsynth_wrapper *) instance;
+	DenormalGuard denormal_guard;
+
+	if (a->spent_bank) {
+		amsynth_work work = { amsynth_work::kFreeBank, a->spent_bank };
+		if (a->schedule->schedule_work(a->schedule->handle, sizeof(work), &work) == LV2_WORKER_SUCCESS)
+			a->spent_bank = NULL;
+	}
+	// work() couldn't respond, so no work_response() is coming: try again
+	if (__sync_lock_test_and_set(&a->bank_load_lost, 0)) {
+		a->bank_load_in_flight = false;
+		a->bank_load_pending = true;
+	}
+	// one load at a time, so work_response() always finds spent_bank free
+	if (a->bank_load_pending && !a->bank_load_in_flight && !a->spent_bank) {
+		amsynth_work work = { amsynth_work::kLoadBank, NULL };
+		if (a->schedule->schedule_work(a->schedule->handle, sizeof(work), &work) == LV2_WORKER_SUCCESS) {
+			a->bank_load_pending = false;
+			a->bank_load_in_flight = true;
+		}
+	}
+
+	// applied by Process() if it has changed. the port is lv2:connectionOptional,
+	// if the host leaves it unconnected the quality from the config file is kept
+	if (a->quality_port) {
+		const long quality = lrintf(*a->quality_port);
+		a->vau->setQuality (quality <= QualityEco ? QualityEco : quality >= QualityHigh ? QualityHigh : QualityStandard);
+	}
 
 	Preset &preset = a->bank->getCurrentPreset();
 
+	// only ports the host has changed since the last block are applied, so a value set by a
+	// MIDI CC sticks until the host actually moves the port
+	const bool apply_port_values = !a->port_values_restored;
+	a->port_values_restored = false;
+	for (unsigned i=0; i<kAmsynthParameterCount; i++) {
+		const float *host_value = a->params[i];
+		if (host_value != NULL && !(*host_value == a->port_values[i])) {
+			a->port_values[i] = *host_value;
+			if (apply_port_values) {
+				preset.setValue(i, *host_value);
+				a->changes->clear(i); // the host already knows
+			}
+		}
+	}
+
+	// all of the block's MIDI is applied as one batch, so that automation sending many
+	// values to one controller only sets the parameter once
+	MidiMessage messages[256];
+	unsigned message_count = 0;
 	LV2_ATOM_SEQUENCE_FOREACH(a->midi_in_port, ev) {
 		if (ev->body.type == a->uris.midiEvent) {
-			uint32_t size = ev->body.size;
-			uint8_t *data = (uint8_t *)(ev + 1);
-			a->mc->HandleMidiData(data, size);
-			if (MIDI_STATUS_CONTROLLER == (data[0] & 0xF0)) {
-				for (unsigned int i=0; i<kAmsynthParameterCount; i++) {
-					float value = preset.getParameter(i).getValue();
-					if (*(a->params[i]) != value) {
-						*(a->params[i]) = value;
-					}
+			const uint8_t *data = (const uint8_t *)(ev + 1);
+			for (uint32_t i = 0; i < ev->body.size; i++) {
+				MidiMessage &message = messages[message_count];
+				if (!a->midi_decoder.decode(data[i], message))
+					continue;
+				message.frame = ev->time.frames;
+				if (++message_count == sizeof(messages) / sizeof(messages[0])) {
+					a->mc->HandleMidiMessages(messages, message_count);
+					message_count = 0;
 				}
 			}
 		}
 	}
+	a->mc->HandleMidiMessages(messages, message_count);
 
-	for (unsigned i=0; i<kAmsynthParameterCount; i++) {
-		const float *host_value = a->params[i];
-		if (host_value != NULL) {
-			if (preset.getParameter(i).getValue() != *host_value) {
-				preset.getParameter(i).setValue(*host_value);
-			}
+	write_parameter_changes(a);
+	update_snapshot(a);
+
+	a->vau->Process (a->out_l, a->out_r, sample_count);
+}
+
+// called by the host's worker thread
+static LV2_Worker_Status
+work(LV2_Handle                  instance,
+     LV2_Worker_Respond_Function respond,
+     LV2_Worker_Respond_Handle   handle,
+     uint32_t                    size,
+     const void*                 data)
+{
+	amsynth_wrapper * a = (amsynth_wrapper *) instance;
+	if (size != sizeof(amsynth_work))
+		return LV2_WORKER_ERR_UNKNOWN;
+	const amsynth_work *message = (const amsynth_work *) data;
+
+	switch (message->type) {
+	case amsynth_work::kLoadBank: {
+		pthread_mutex_lock(&a->bank_file_mutex);
+		const std::string bank_file = *a->bank_file;
+		pthread_mutex_unlock(&a->bank_file_mutex);
+		// always responds, even if loading failed, so lv2_run() knows it may load another bank
+		PresetController *bank = BankLoader::createBank(bank_file.c_str());
+		if (respond(handle, sizeof(bank), &bank) != LV2_WORKER_SUCCESS) {
+			delete bank;
+			__sync_lock_test_and_set(&a->bank_load_lost, 1);
+			return LV2_WORKER_ERR_NO_SPACE;
 		}
+		break;
 	}
+	case amsynth_work::kFreeBank:
+		delete message->bank;
+		break;
+	}
+	return LV2_WORKER_SUCCESS;
+}
 
-	a->vau->Process (a->out_l, a->out_r, sample_count);
+// called in the audio thread with the bank loaded by work()
+static LV2_Worker_Status
+work_response(LV2_Handle  instance,
+              uint32_t    size,
+              const void* body)
+{
+	amsynth_wrapper * a = (amsynth_wrapper *) instance;
+	if (size != sizeof(PresetController *))
+		return LV2_WORKER_ERR_UNKNOWN;
+	PresetController *bank = *(PresetController * const *) body;
+
+	a->bank_load_in_flight = false;
+	if (!bank)
+		return LV2_WORKER_SUCCESS;
+
+	if (a->bank_load_pending) {
+		// restore() has asked for a different bank since this one was requested
+		a->spent_bank = bank;
+		return LV2_WORKER_SUCCESS;
+	}
+
+	a->bank->adoptPresets(*bank);
+
+	// a restored preset is kept, otherwise the host's port values take precedence
+	// over the first preset of the bank
+	if (!a->state_restored) {
+		a->bank->selectPreset(0);
+		for (int i = 0; i < kAmsynthParameterCount; i++)
+			a->port_values[i] = NAN;
+	}
+
+	// bank now holds the presets we had before, lv2_run() sends them back to the worker to be freed.
+	a->spent_bank = bank;
+	return LV2_WORKER_SUCCESS;
+}
+
+//
+// The state is a single atom:Chunk holding, in little endian byte order:
+//
+//   magic "amSynthS", version
+//   parameter count, parameter values (float, in Param order)
+//   preset name, bank file (length and bytes, abstract if the host maps paths)
+//   tuning count, tuning (double, see TuningMap::getState())
+//
+// so a session restores the sound without the host replaying every control port,
+// and without reading the bank file, which is loaded later by the worker.
+//
+
+static const char kStateMagic[8] = { 'a', 'm', 'S', 'y', 'n', 't', 'h', 'S' };
+static const uint32_t kStateVersion = 1;
+
+static void
+state_put_u32(std::string &data, uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+		data += (char)(value >> (8 * i));
+}
+
+static void
+state_put_u64(std::string &data, uint64_t value)
+{
+	state_put_u32(data, (uint32_t)value);
+	state_put_u32(data, (uint32_t)(value >> 32));
+}
+
+static void
+state_put_string(std::string &data, const std::string &value)
+{
+	state_put_u32(data, value.size());
+	data += value;
+}
+
+// the host's state:mapPath feature, or NULL
+static const LV2_State_Map_Path *
+state_map_path(const LV2_Feature* const* features)
+{
+	for (int i = 0; features && features[i]; ++i)
+		if (!strcmp(features[i]->URI, LV2_STATE__mapPath))
+			return (const LV2_State_Map_Path *)features[i]->data;
+	return NULL;
 }
 
+struct state_reader
+{
+	const unsigned char *data;
+	size_t size;
+	size_t offset;
+	bool failed;
+
+	bool read(void *dst, size_t length)
+	{
+		if (failed || length > size - offset) {
+			failed = true;
+			return false;
+		}
+		memcpy(dst, data + offset, length);
+		offset += length;
+		return true;
+	}
+
+	uint32_t u32()
+	{
+		unsigned char b[4] = { 0 };
+		read(b, 4);
+		return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+	}
+
+	uint64_t u64()
+	{
+		uint64_t lo = u32();
+		return lo | ((uint64_t)u32() << 32);
+	}
+
+	// false, and failed, if fewer than count elements of size bytes remain
+	bool has(uint32_t count, size_t element_size)
+	{
+		if (failed || count > (size - offset) / element_size)
+			failed = true;
+		return !failed;
+	}
+
+	std::string string()
+	{
+		uint32_t length = u32();
+		if (failed || length > size - offset) {
+			failed = true;
+			return std::string();
+		}
+		std::string value((const char *)data + offset, length);
+		offset += length;
+		return value;
+	}
+};
+
 static LV2_State_Status
 save(LV2_Handle                instance,
      LV2_State_Store_Function  store,
@@ -183,10 +572,49 @@ save(LV2_Handle                instance,
 {
 	LOG_FUNCTION_CALL();
 
-	// host takes care of saving port values
-	// we have no additional state to save
+	amsynth_wrapper * a = (amsynth_wrapper *) instance;
 
-	return LV2_STATE_SUCCESS;
+	// lv2_run() may be updating the snapshot, retry until we get a consistent copy
+	float values[kAmsynthParameterCount];
+	char name[sizeof(a->snapshot.name)];
+	unsigned sequence;
+	do {
+		sequence = a->snapshot.sequence;
+		__sync_synchronize();
+		memcpy(values, a->snapshot.values, sizeof(values));
+		memcpy(name, a->snapshot.name, sizeof(name));
+		__sync_synchronize();
+	} while ((sequence & 1) || sequence != a->snapshot.sequence);
+	name[sizeof(name) - 1] = '\0';
+
+	std::string data(kStateMagic, sizeof(kStateMagic));
+	state_put_u32(data, kStateVersion);
+	state_put_u32(data, kAmsynthParameterCount);
+	for (int i = 0; i < kAmsynthParameterCount; i++) {
+		uint32_t bits;
+		memcpy(&bits, &values[i], sizeof(bits));
+		state_put_u32(data, bits);
+	}
+	state_put_string(data, name);
+
+	// the state is only portable if the host maps the bank file's path
+	// a->bank_file is only written by restore(), which can't run concurrently
+	const LV2_State_Map_Path *map_path = state_map_path(features);
+	char *bank_file = map_path ? map_path->abstract_path(map_path->handle, a->bank_file->c_str()) : NULL;
+	state_put_string(data, bank_file ? bank_file : *a->bank_file);
+	free(bank_file);
+
+	std::vector<double> tuning;
+	a->vau->getTuningMap().getState(tuning);
+	state_put_u32(data, tuning.size());
+	for (size_t i = 0; i < tuning.size(); i++) {
+		uint64_t bits;
+		memcpy(&bits, &tuning[i], sizeof(bits));
+		state_put_u64(data, bits);
+	}
+
+	return store(handle, a->uris.amsynth_state, data.data(), data.size(), a->uris.atom_Chunk,
+	             LV2_STATE_IS_POD | (map_path ? LV2_STATE_IS_PORTABLE : 0));
 }
 
 static LV2_State_Status
@@ -198,9 +626,70 @@ restore(LV2_Handle                  instance,
 {
 	LOG_FUNCTION_CALL();
 
-	// host takes care of restoring port values
-	// we have no additional state to restore
-	
+	amsynth_wrapper * a = (amsynth_wrapper *) instance;
+
+	size_t size = 0;
+	uint32_t type = 0;
+	uint32_t value_flags = 0;
+	const void *value = retrieve(handle, a->uris.amsynth_state, &size, &type, &value_flags);
+	if (!value || type != a->uris.atom_Chunk)
+		return LV2_STATE_SUCCESS; // nothing saved, keep the current state
+
+	state_reader reader = { (const unsigned char *)value, size, 0, false };
+	char magic[sizeof(kStateMagic)];
+	if (!reader.read(magic, sizeof(magic)) || memcmp(magic, kStateMagic, sizeof(magic)) ||
+		reader.u32() != kStateVersion)
+		return LV2_STATE_ERR_BAD_TYPE;
+
+	Preset preset;
+	const uint32_t parameter_count = reader.u32();
+	for (uint32_t i = 0; i < parameter_count && !reader.failed; i++) {
+		uint32_t bits = reader.u32();
+		float parameter_value;
+		memcpy(&parameter_value, &bits, sizeof(parameter_value));
+		if (i < kAmsynthParameterCount) // parameters are only ever added at the end
+			preset.setValue(i, parameter_value);
+	}
+	preset.setName(reader.string());
+	std::string bank_file = reader.string();
+	const LV2_State_Map_Path *map_path = state_map_path(features);
+	char *absolute_path = map_path && !reader.failed ? map_path->absolute_path(map_path->handle, bank_file.c_str()) : NULL;
+	if (absolute_path)
+		bank_file = absolute_path;
+	free(absolute_path);
+
+	// the count is checked against the data, so a corrupt chunk can't ask for a huge allocation
+	const uint32_t tuning_count = reader.u32();
+	if (!reader.has(tuning_count, sizeof(uint64_t)))
+		return LV2_STATE_ERR_BAD_TYPE;
+	std::vector<double> tuning(tuning_count);
+	for (size_t i = 0; i < tuning.size() && !reader.failed; i++) {
+		uint64_t bits = reader.u64();
+		memcpy(&tuning[i], &bits, sizeof(bits));
+	}
+	TuningMap tuning_map;
+	if (reader.failed || tuning_map.setState(tuning) != 0)
+		return LV2_STATE_ERR_BAD_TYPE;
+
+	// restore() is never called concurrently with lv2_run(), so everything is applied at once here
+	a->vau->setTuningMap(tuning_map);
+	a->bank->getCurrentPreset() = preset;
+	a->state_restored = true;
+
+	// only port values the host changes from now on override the restored preset
+	a->port_values_restored = true;
+
+	if (bank_file != *a->bank_file) {
+		pthread_mutex_lock(&a->bank_file_mutex);
+		*a->bank_file = bank_file;
+		pthread_mutex_unlock(&a->bank_file_mutex);
+		if (a->schedule)
+			a->bank_load_pending = true;
+		else if (a->bank->loadPresets(bank_file.c_str()) == 0)
+			a->bank->readAllPresets();
+	}
+
+	update_snapshot(a);
 	return LV2_STATE_SUCCESS;
 }
 
@@ -213,6 +702,10 @@ lv2_extension_data(const char *uri)
 		static const LV2_State_Interface state = { save, restore };
 		return &state;
 	}
+	if (!strcmp(uri, LV2_WORKER__interface)) {
+		static const LV2_Worker_Interface worker = { work, work_response, NULL };
+		return &worker;
+	}
 	return NULL;
 }
 
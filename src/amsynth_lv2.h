@@ -0,0 +1,56 @@
+/*
+ *  amsynth_lv2.h
+ *
+ *  Copyright (c) 2001-2012 Nick Dowell
+ *
+ *  This file is part of amsynth.
+ *
+ *  amsynth is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  amsynth is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with amsynth.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _AMSYNTH_LV2_H
+#define _AMSYNTH_LV2_H
+
+#include "controls.h"
+
+#include "lv2/lv2plug.in/ns/ext/patch/patch.h"
+
+// definitions shared by the LV2 plugin and its UI, must match amsynth.ttl
+
+#define AMSYNTH_LV2_URI			"http://code.google.com/p/amsynth/amsynth"
+
+// patch:property of a parameter is this prefix followed by the parameter name
+#define AMSYNTH_LV2_PARAMETER_URI_PREFIX	AMSYNTH_LV2_URI "/parameter#"
+
+// missing from the bundled patch.h
+#ifndef LV2_PATCH__property
+#define LV2_PATCH__property		LV2_PATCH_PREFIX "property"
+#endif
+#ifndef LV2_PATCH__value
+#define LV2_PATCH__value		LV2_PATCH_PREFIX "value"
+#endif
+
+enum {
+	kAmsynthLV2PortOutL = 0,
+	kAmsynthLV2PortOutR,
+	kAmsynthLV2PortMidiIn,
+	kAmsynthLV2PortFirstParameter,
+	// atom output carrying a patch:Set for each parameter changed by the plugin
+	kAmsynthLV2PortControlOut = kAmsynthLV2PortFirstParameter + kAmsynthParameterCount,
+	// synthesis quality, a Quality value. optional, when a host connects it the
+	// config file's quality is overridden
+	kAmsynthLV2PortQuality
+};
+
+#endif
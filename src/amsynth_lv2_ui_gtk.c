@@ -21,14 +21,18 @@
 
 ////////////////////////////////////////////////////////////////////////////////
 
+#include "amsynth_lv2.h"
 #include "controls.h"
 #include "Preset.h"
 #include "GUI/editor_pane.h"
 
 #include "lv2/lv2plug.in/ns/lv2core/lv2.h"
 #include "lv2/lv2plug.in/ns/extensions/ui/ui.h"
+#include "lv2/lv2plug.in/ns/ext/atom/util.h"
+#include "lv2/lv2plug.in/ns/ext/urid/urid.h"
 
 #include <stdio.h>
+#include <string.h>
 
 // works around an issue in qtractor version <= 0.5.6
 // http://sourceforge.net/p/qtractor/tickets/19/
@@ -36,10 +40,6 @@
 
 ////////////////////////////////////////////////////////////////////////////////
 
-enum {
-	kAmsynthPortIndexForFirstParameter = 3,
-};
-
 typedef struct {
 	GtkWidget *_widget;
 	GtkAdjustment *_adjustments[kAmsynthParameterCount];
@@ -50,6 +50,15 @@ typedef struct {
 	LV2UI_Write_Function _write_function;
 	LV2UI_Controller _controller;
 	guint _timeout_id;
+	struct {
+		LV2_URID atom_eventTransfer;
+		LV2_URID atom_Float;
+		LV2_URID atom_URID;
+		LV2_URID patch_Set;
+		LV2_URID patch_property;
+		LV2_URID patch_value;
+		LV2_URID parameters[kAmsynthParameterCount];
+	} _uris; // all zero if the host doesn't provide urid:map
 } lv2_ui;
 
 static void on_adjustment_value_changed(GtkAdjustment *adjustment, gpointer user_data);
@@ -65,7 +74,7 @@ static gboolean lv2_ui_on_idle(gpointer data)
 		if (ui->_adjustment_changed[i] && ui->_adjustments[i]) {
 			float value = gtk_adjustment_get_value(ui->_adjustments[i]);
 			ui->_write_function(ui->_controller,
-				kAmsynthPortIndexForFirstParameter + i,
+				kAmsynthLV2PortFirstParameter + i,
 				sizeof(float), 0, &value);
 		}
 	}
@@ -89,6 +98,25 @@ lv2_ui_instantiate(const struct _LV2UI_Descriptor* descriptor,
 	ui->_write_function = write_function;
 	ui->_controller = controller;
 
+	LV2_URID_Map *urid_map = NULL;
+	int f; for (f = 0; features[f]; f++) {
+		if (!strcmp(features[f]->URI, LV2_URID__map))
+			urid_map = (LV2_URID_Map *)features[f]->data;
+	}
+	if (urid_map) {
+		ui->_uris.atom_eventTransfer = urid_map->map(urid_map->handle, LV2_ATOM__eventTransfer);
+		ui->_uris.atom_Float = urid_map->map(urid_map->handle, LV2_ATOM__Float);
+		ui->_uris.atom_URID = urid_map->map(urid_map->handle, LV2_ATOM__URID);
+		ui->_uris.patch_Set = urid_map->map(urid_map->handle, LV2_PATCH__Set);
+		ui->_uris.patch_property = urid_map->map(urid_map->handle, LV2_PATCH__property);
+		ui->_uris.patch_value = urid_map->map(urid_map->handle, LV2_PATCH__value);
+		size_t i; for (i=0; i<kAmsynthParameterCount; i++) {
+			gchar *uri = g_strconcat(AMSYNTH_LV2_PARAMETER_URI_PREFIX, parameter_name_from_index(i), NULL);
+			ui->_uris.parameters[i] = urid_map->map(urid_map->handle, uri);
+			g_free(uri);
+		}
+	}
+
 	size_t i; for (i=0; i<kAmsynthParameterCount; i++) {
 		gdouble value = 0, lower = 0, upper = 0, step_increment = 0;
 		get_parameter_properties(i, &lower, &upper, &value, &step_increment);
@@ -135,7 +163,7 @@ on_adjustment_value_changed(GtkAdjustment *adjustment, gpointer user_data)
 			float value = gtk_adjustment_get_value(adjustment);
 			if (ui->_write_function != 0) {
 				ui->_write_function(ui->_controller,
-					kAmsynthPortIndexForFirstParameter + i,
+					kAmsynthLV2PortFirstParameter + i,
 					sizeof(float), 0, &value);
 			}
 #endif
@@ -145,23 +173,58 @@ on_adjustment_value_changed(GtkAdjustment *adjustment, gpointer user_data)
 }
 
 static void
-lv2_ui_port_event(LV2UI_Handle ui,
+set_parameter_value(lv2_ui *ui, int parameter_index, float value)
+{
+	GtkAdjustment *adjustment = ui->_adjustments[parameter_index];
+	ui->_dont_send_control_changes = TRUE;
+	gtk_adjustment_set_value(adjustment, value);
+#if CALL_LV2UI_WRITE_FUNCTION_ON_IDLE
+	ui->_adjustment_changed[parameter_index] = FALSE;
+#endif
+	ui->_dont_send_control_changes = FALSE;
+}
+
+// a patch:Set sent by the plugin on its control output port
+static void
+on_patch_set(lv2_ui *ui, const LV2_Atom_Object *object)
+{
+	const LV2_Atom *property = NULL;
+	const LV2_Atom *value = NULL;
+	lv2_atom_object_get(object, ui->_uris.patch_property, &property, ui->_uris.patch_value, &value, 0);
+	if (!property || property->type != ui->_uris.atom_URID ||
+		!value || value->type != ui->_uris.atom_Float)
+		return;
+
+	LV2_URID parameter_uri = ((const LV2_Atom_URID *)property)->body;
+	int i; for (i = 0; i < kAmsynthParameterCount; i++) {
+		if (ui->_uris.parameters[i] == parameter_uri) {
+			set_parameter_value(ui, i, ((const LV2_Atom_Float *)value)->body);
+			break;
+		}
+	}
+}
+
+static void
+lv2_ui_port_event(LV2UI_Handle handle,
 				  uint32_t     port_index,
 				  uint32_t     buffer_size,
 				  uint32_t     format,
 				  const void*  buffer)
 {
-	int parameter_index = port_index - kAmsynthPortIndexForFirstParameter;
+	lv2_ui *ui = handle;
+
+	if (port_index == kAmsynthLV2PortControlOut) {
+		const LV2_Atom_Object *object = buffer;
+		if (format != 0 && format == ui->_uris.atom_eventTransfer &&
+			object->body.otype == ui->_uris.patch_Set)
+			on_patch_set(ui, object);
+		return;
+	}
+
+	int parameter_index = port_index - kAmsynthLV2PortFirstParameter;
 	if (parameter_index < 0 || parameter_index >= kAmsynthParameterCount)
 		return;
-	float value = *(float *)buffer;
-	GtkAdjustment *adjustment = ((lv2_ui *)ui)->_adjustments[parameter_index];
-	((lv2_ui *)ui)->_dont_send_control_changes = TRUE;
-	gtk_adjustment_set_value(adjustment, value);
-#if CALL_LV2UI_WRITE_FUNCTION_ON_IDLE
-	((lv2_ui *)ui)->_adjustment_changed[parameter_index] = FALSE;
-#endif
-	((lv2_ui *)ui)->_dont_send_control_changes = FALSE;
+	set_parameter_value(ui, parameter_index, *(float *)buffer);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,180 @@
+/*
+ *  amsynth_stat.cc
+ *
+ *  Copyright (c) 2001-2012 Nick Dowell
+ *
+ *  This file is part of amsynth.
+ *
+ *  amsynth is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  amsynth is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with amsynth.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// amsynth-stat: prints the statistics published by running amsynth instances
+// which have export_metrics enabled, see Metrics.h
+
+#include "Metrics.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static const char *usage =
+"usage: amsynth-stat [-i seconds] [-n count] [pid ...]\n"
+"\n"
+"Prints the statistics of running amsynth instances every few seconds.\n"
+"With no pid, every instance which publishes statistics is shown.\n"
+"\n"
+"-i seconds	the interval between reports (default 1)\n"
+"-n count	stop after count reports\n";
+
+struct Instance
+{
+	string			name;
+	MetricsReader	*reader;
+	MetricsSnapshot	last;
+	bool			valid;
+};
+
+// the segments in /dev/shm which look like ours
+static vector<string>
+find_instances ()
+{
+	vector<string> names;
+	DIR *dir = opendir ("/dev/shm");
+	if (!dir)
+		return names;
+	while (struct dirent *entry = readdir (dir))
+		if (strncmp (entry->d_name, "amsynth-", 8) == 0)
+			names.push_back (string ("/") + entry->d_name);
+	closedir (dir);
+	return names;
+}
+
+static double
+per_second (uint64_t count, double seconds)
+{
+	return seconds > 0 ? count / seconds : 0;
+}
+
+static void
+report (Instance &instance)
+{
+	MetricsSnapshot now;
+	if (!instance.reader->read (now))
+		return;
+	if (!instance.valid || now.time <= instance.last.time) {
+		instance.last = now;
+		instance.valid = true;
+		return;
+	}
+	const MetricsSnapshot &then = instance.last;
+	const double seconds = (now.time - then.time) * 1e-6;
+	// render time as a percentage of the duration of the audio rendered
+	const double audio_ns = now.sample_rate ? (now.frames - then.frames) * 1e9 / now.sample_rate : 0;
+	double stage_load[kMetricsStageCount];
+	for (int i = 0; i < kMetricsStageCount; i++)
+		stage_load[i] = audio_ns > 0 ? 100.0 * (now.render_ns[i] - then.render_ns[i]) / audio_ns : 0;
+
+	printf ("%7u %6u %4u %8llu %6.1f %6.1f %6.1f %6llu %8.1f %8.1f",
+			instance.reader->pid (),
+			now.active_voices, now.max_voices,
+			(unsigned long long) now.voices_stolen,
+			stage_load[kMetricsStageVoices] + stage_load[kMetricsStageEffects],
+			stage_load[kMetricsStageVoices], stage_load[kMetricsStageEffects],
+			(unsigned long long) now.xruns,
+			per_second (now.midi_events - then.midi_events, seconds),
+			per_second (now.parameter_changes - then.parameter_changes, seconds));
+	if (now.flags & kMetricsDenormalCount)
+		printf (" %8llu", (unsigned long long) now.denormal_blocks);
+	else
+		printf (" %8s", "-");
+	if (now.driver_dsp_load > 0)
+		printf (" %6.1f\n", now.driver_dsp_load);
+	else
+		printf (" %6s\n", "-");
+	instance.last = now;
+}
+
+int
+main (int argc, char *argv[])
+{
+	double interval = 1;
+	long count = -1;
+	int opt;
+	while ((opt = getopt (argc, argv, "i:n:h")) != -1) {
+		switch (opt) {
+		case 'i': interval = atof (optarg); break;
+		case 'n': count = atol (optarg); break;
+		default: fputs (usage, stderr); return 1;
+		}
+	}
+	if (interval <= 0) {
+		fputs (usage, stderr);
+		return 1;
+	}
+
+	vector<string> names;
+	for (int i = optind; i < argc; i++)
+		names.push_back (string ("/amsynth-") + argv[i]);
+	if (names.empty ())
+		names = find_instances ();
+
+	vector<Instance> instances;
+	for (size_t i = 0; i < names.size (); i++) {
+		Instance instance;
+		instance.name = names[i];
+		instance.reader = new MetricsReader;
+		instance.valid = false;
+		errno = 0;
+		if (!instance.reader->open (names[i].c_str ())) {
+			fprintf (stderr, "amsynth-stat: cannot read %s: %s\n", names[i].c_str (),
+					 errno ? strerror (errno) : "not an amsynth statistics segment");
+			delete instance.reader;
+			continue;
+		}
+		// left behind by an instance which crashed
+		if (kill (instance.reader->pid (), 0) == -1 && errno == ESRCH) {
+			delete instance.reader;
+			continue;
+		}
+		report (instance);
+		instances.push_back (instance);
+	}
+	if (instances.empty ()) {
+		fprintf (stderr, "amsynth-stat: no running instances are publishing statistics (see export_metrics in ~/.amSynthrc)\n");
+		return 1;
+	}
+
+	for (long n = 0; count < 0 || n < count; n++) {
+		usleep ((useconds_t) (interval * 1e6));
+		printf ("%7s %6s %4s %8s %6s %6s %6s %6s %8s %8s %8s %6s\n",
+				"pid", "voices", "max", "stolen", "load%", "voice%", "fx%",
+				"xruns", "midi/s", "param/s", "denorm", "jack%");
+		for (size_t i = 0; i < instances.size (); i++)
+			report (instances[i]);
+		fflush (stdout);
+	}
+
+	for (size_t i = 0; i < instances.size (); i++)
+		delete instances[i].reader;
+	return 0;
+}
@@ -87,6 +87,13 @@ typedef enum {
 	KeyboardModeLegato,
 } KeyboardMode;
 
+// trades sound quality for CPU usage, see VoiceAllocationUnit::setQuality()
+typedef enum {
+	QualityEco,
+	QualityStandard,
+	QualityHigh,
+} Quality;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -94,6 +101,9 @@ extern "C" {
 const char *parameter_name_from_index (int param_index);
 int parameter_index_from_name (const char *param_name);
 
+/* "eco", "standard" or "high", anything else is QualityStandard */
+Quality quality_from_name (const char *name);
+
 int parameter_get_display (int parameter_index, float parameter_value, char *buffer, size_t maxlen);
 const char **parameter_get_value_strings (int parameter_index);
 
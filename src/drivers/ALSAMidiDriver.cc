@@ -42,6 +42,7 @@ public:
 	int		write_cc		(unsigned int channel, unsigned int param, unsigned int value);
 	int 	open			( Config & config );
 	int 	close			( );
+	int		get_poll_fd		( ) { return seq_handle ? pollfd_in.fd : -1; }
 private:
 	snd_seq_t		*seq_handle;
 	snd_midi_event_t	*seq_midi_parser;
@@ -57,14 +58,16 @@ ALSAMidiDriver::read(unsigned char *bytes, unsigned maxBytes)
 	if (seq_handle == NULL) {
 		return 0;
 	}
+	// skip events which don't decode to MIDI bytes (e.g. port subscriptions), they
+	// may be followed by more input already buffered, which poll() won't report
 	snd_seq_event_t *ev = NULL;
-	int res = snd_seq_event_input( seq_handle, &ev );
-	if (res == -EAGAIN) {
-		return 0;
+	while (snd_seq_event_input( seq_handle, &ev ) >= 0 && ev) {
+		int num_bytes = snd_midi_event_decode( seq_midi_parser, bytes, maxBytes, ev );
+		snd_seq_free_event( ev );
+		if (num_bytes > 0)
+			return num_bytes;
 	}
-	int num_bytes = snd_midi_event_decode( seq_midi_parser, bytes, maxBytes, ev );
-	snd_seq_free_event( ev );
-	return num_bytes;
+	return 0;
 }
 
 int
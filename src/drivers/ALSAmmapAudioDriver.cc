@@ -23,6 +23,7 @@
 #include "../../config.h"
 #endif
 
+#include <cstring>
 #include <iostream>
 
 #include "ALSAmmapAudioDriver.h"
@@ -63,70 +64,119 @@ int
 ALSAmmapAudioDriver::write(float *buffer, int frames)
 {
 #ifdef WITH_ALSA
-	int i,p;
+	return transfer(buffer, NULL, frames / _channels);
+#else //with_alsa
+	UNUSED_PARAM(buffer);
+	UNUSED_PARAM(frames);
+	return -1;
+#endif
+}
+
+int
+ALSAmmapAudioDriver::render(AudioCallback callback, int frames)
+{
+#ifdef WITH_ALSA
+	return transfer(NULL, callback, frames);
+#else //with_alsa
+	UNUSED_PARAM(callback);
+	UNUSED_PARAM(frames);
+	return -1;
+#endif
+}
+
+// Copies interleaved frames from buffer into the mmap area, or if buffer is NULL, has
+// callback render them. Float output is rendered straight into the mmap area, other
+// formats are rendered into render_buffer and converted from there in one pass.
+int
+ALSAmmapAudioDriver::transfer(float *buffer, AudioCallback callback, int frames)
+{
+#ifdef WITH_ALSA
 	snd_pcm_sframes_t avail;
-	snd_pcm_uframes_t offset, lframes = frames / 2;
 	const snd_pcm_channel_area_t* areas;
-	short int*		audiobuf;
 
 	while( 1 )
 	{
 		avail = snd_pcm_avail_update( playback_handle);
 		if (avail < 0)
 		{
-//			char b[ 80];
-//			sprintf( b, "%i", err = avail);
-//			cerr << "snd_pcm_avail_update error " << b << "=\"" 
-//			<< snd_strerror( err) << "\"\n";
+			err = avail;
 			return xrun_recovery();
 		}
-		lframes = frames / 2;
-		if( (int)avail >= (int)lframes ) break;
+		if( (int)avail >= frames ) break;
 		if( 0 > ( err = snd_pcm_wait( playback_handle, -1)))
 		{
-//			cerr << "snd_pcm_wait error\n";
 			config->xruns++;
 			return xrun_recovery();
 		}
 	}
 
-	if( 0 > ( err = snd_pcm_mmap_begin( playback_handle, &areas, &offset, &lframes)))
+	// the mmap area may wrap around before frames is reached
+	while (frames > 0)
 	{
-		cerr << "snd_pcm_mmap_begin error\n";
-		xrun_recovery();
-		// Return an error code so we can quickly test during initialisation.
-		// Won't stop playback at runtime because AudioOutput checks for a return code of -1
-		return 0xfeedface;
-	}
+		snd_pcm_uframes_t offset, lframes = frames;
+		if (!buffer && _format != SND_PCM_FORMAT_FLOAT && lframes > render_buffer_frames)
+			lframes = render_buffer_frames;
 
-	audiobuf = (short int*)areas[ 0].addr + 2*offset;
-	p=0;
-	for( i=0; i<(frames); i++ )
-		*(audiobuf++) = (int)(32767*( 1.0 + buffer[i])) - 32767;
+		if( 0 > ( err = snd_pcm_mmap_begin( playback_handle, &areas, &offset, &lframes)))
+		{
+			cerr << "snd_pcm_mmap_begin error\n";
+			xrun_recovery();
+			// Return an error code so we can quickly test during initialisation.
+			// Won't stop playback at runtime because AudioOutput checks for a return code of -1
+			return 0xfeedface;
+		}
 
-	if( 0 > ( err = snd_pcm_mmap_commit(  playback_handle, offset, lframes)))
-	{
-		cerr << "snd_pcm_mmap_commit error\n";
-		return xrun_recovery();
+		// MMAP_INTERLEAVED: every channel shares areas[0], one frame per step
+		unsigned char *dst = (unsigned char *)areas[0].addr + (areas[0].first + offset * areas[0].step) / 8;
+		const unsigned samples = lframes * _channels;
+
+		const float *src = buffer;
+		if (!buffer) {
+			if (_format == SND_PCM_FORMAT_FLOAT) {
+				callback((float *)dst, (float *)dst + 1, lframes, _channels);
+			} else {
+				callback(render_buffer, render_buffer + 1, lframes, _channels);
+				src = render_buffer;
+			}
+		}
+		if (src) {
+			switch (_format) {
+			case SND_PCM_FORMAT_FLOAT:
+				memcpy(dst, src, samples * sizeof(float));
+				break;
+			case SND_PCM_FORMAT_S32:
+				float_to_s32(src, (int32_t *)dst, samples);
+				break;
+			case SND_PCM_FORMAT_S24_3LE:
+				float_to_s24_3le(src, dst, samples, use_dither ? &dither : NULL);
+				break;
+			default:
+				float_to_s16(src, (int16_t *)dst, samples, use_dither ? &dither : NULL);
+				break;
+			}
+		}
+		if (buffer)
+			buffer += samples;
+
+		if( 0 > ( err = snd_pcm_mmap_commit(  playback_handle, offset, lframes)))
+		{
+			cerr << "snd_pcm_mmap_commit error\n";
+			return xrun_recovery();
+		}
+		frames -= lframes;
 	}
 
 	if( periods < 2)
 		if( 2 == ++periods )
-//				cerr << "snd_pcm_start soon\n";
 			if( 0 > ( err = snd_pcm_start( playback_handle ) ) )
 			{
 				cerr << "snd_pcm_start error\n";
 				return -1;
 			}
-	/*else{
-		if( ++periods == 0)
-			periods = 2;
-		if( ! ( periods % 0x100))
-				cerr << "( periods % 0x100)\n";
-	}*/
 	return 0;
 #else //with_alsa
 	UNUSED_PARAM(buffer);
+	UNUSED_PARAM(callback);
 	UNUSED_PARAM(frames);
 	return -1;
 #endif
@@ -138,6 +188,8 @@ ALSAmmapAudioDriver::open( Config & config )
 #ifdef WITH_ALSA
 	if (playback_handle != NULL) return 0;
 	
+	// the synth renders interleaved stereo straight into the mmap area
+	if (config.channels != 2) return -1;
 	_channels = config.channels;
 	_rate = config.sample_rate;
 
@@ -148,7 +200,19 @@ ALSAmmapAudioDriver::open( Config & config )
     snd_pcm_hw_params_alloca( &hw_params );
     snd_pcm_hw_params_any( playback_handle, hw_params );
     snd_pcm_hw_params_set_access( playback_handle, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED/*SND_PCM_ACCESS_RW_INTERLEAVED*/ );
-    snd_pcm_hw_params_set_format( playback_handle, hw_params, SND_PCM_FORMAT_S16_LE );
+
+	// use the device's native sample format where possible, to avoid conversion by alsa-lib
+	static const snd_pcm_format_t formats[] = {
+		SND_PCM_FORMAT_FLOAT, SND_PCM_FORMAT_S32, SND_PCM_FORMAT_S24_3LE, SND_PCM_FORMAT_S16
+	};
+	_format = SND_PCM_FORMAT_S16;
+	for (unsigned i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+		if (snd_pcm_hw_params_test_format( playback_handle, hw_params, formats[i] ) == 0) {
+			_format = formats[i];
+			break;
+		}
+	}
+    snd_pcm_hw_params_set_format( playback_handle, hw_params, (snd_pcm_format_t)_format );
     snd_pcm_hw_params_set_rate_near( playback_handle, hw_params, _rate, 0 );
     snd_pcm_hw_params_set_channels( playback_handle, hw_params, _channels );
 	snd_pcm_hw_params_set_periods( playback_handle, hw_params, 16, 0 );
@@ -157,6 +221,15 @@ ALSAmmapAudioDriver::open( Config & config )
 	
 	config.sample_rate = snd_pcm_hw_params_get_rate( hw_params, 0 );
 	config.current_audio_driver = "ALSA-MMAP";
+
+	delete[] render_buffer;
+	render_buffer_frames = config.buffer_size;
+	render_buffer = new float[render_buffer_frames * _channels];
+	use_dither = config.audio_dither && _format != SND_PCM_FORMAT_S32 && _format != SND_PCM_FORMAT_FLOAT;
+
+	if (config.debug_drivers)
+		cout << "<ALSAmmapAudioDriver> sample format " << snd_pcm_format_name((snd_pcm_format_t)_format)
+			 << (use_dither ? " with dither" : "") << endl;
 #ifdef ENABLE_REALTIME
 	config.current_audio_driver_wants_realtime = 1;
 #endif
@@ -176,6 +249,9 @@ void ALSAmmapAudioDriver::close()
 #ifdef WITH_ALSA
 	if (playback_handle != NULL) snd_pcm_close (playback_handle);
 	playback_handle = NULL;
+	delete[] render_buffer;
+	render_buffer = NULL;
+	render_buffer_frames = 0;
 #endif
 }
 
@@ -203,6 +279,9 @@ ALSAmmapAudioDriver::ALSAmmapAudioDriver()
 {
 #ifdef WITH_ALSA
 	playback_handle = NULL;
+	render_buffer = NULL;
+	render_buffer_frames = 0;
+	use_dither = false;
 #endif
 }
 
@@ -23,6 +23,7 @@
 #define _ALSA_alsa_MMAP_AUDIO_DRIVER_H
 
 #include "AudioDriver.h"
+#include "SampleConversion.h"
 
 #ifdef WITH_ALSA
 #define ALSA_PCM_OLD_HW_PARAMS_API
@@ -40,12 +41,14 @@ public:
 	int	open( Config & config );
 	void	close();
 	int	write(float *buffer, int frames);
+	int	render(AudioCallback callback, int frames);
 	int	setChannels(int channels);
 	int	setRate(int rate);
 	int	setRealtime();
 
 private:
 	int 	xrun_recovery();
+	int	transfer(float *buffer, AudioCallback callback, int frames);
 	
 	int		_dsp_handle;
 	int		_rate;
@@ -59,6 +62,11 @@ private:
 	snd_pcm_sw_params_t	*sw_params;
 	int			err;
 	unsigned		periods;
+	// interleaved float frames rendered before conversion to an integer format
+	float			*render_buffer;
+	unsigned		render_buffer_frames;
+	SampleDither		dither;
+	bool			use_dither;
 #endif
 };
 
@@ -29,6 +29,8 @@
 
 using namespace std;
 
+typedef void (* AudioCallback)(float *buffer_l, float *buffer_r, unsigned num_frames, int stride);
+
 /** 
  * @class AudioDriver
  * @brief A generic audio driver interface
@@ -62,6 +64,15 @@ public:
    */
     virtual int write(float *buffer, int frames)
     = 0;
+  /** 
+   * Renders frames by calling callback with pointers into the driver's own
+   * output buffer, avoiding the intermediate copy needed by write().
+   * @param callback called one or more times to produce interleaved stereo
+   * @param frames number of frames to render
+   * @return 0 on success, -1 on failure, 1 if unsupported (use write()).
+   */
+    virtual int render(AudioCallback callback, int frames)
+    { UNUSED_PARAM(callback); UNUSED_PARAM(frames); return 1; }
   /** 
    * Configures the device for (near) realtime / low latency response.
    * (soon to be deprecated)
@@ -71,6 +71,11 @@ class AudioInterface {
    */
     int write(float *buffer, int frames)
 	{ return driver->write( buffer, frames ); };
+  /** 
+   * Renders directly into the driver's buffer, see AudioDriver::render()
+   */
+    int render(AudioCallback callback, int frames)
+	{ return driver->render( callback, frames ); };
   /** 
    * not implemented yet
    * 
@@ -36,6 +36,8 @@ public:
     virtual int open( Config & config ) = 0;
     virtual int close() = 0;
     virtual int get_alsa_client_id()	{ return 0; };
+    // a descriptor which polls readable when input is available, or -1
+    virtual int get_poll_fd()	{ return -1; };
 };
 
 #endif
@@ -0,0 +1,100 @@
+/*
+ *  MidiEventQueue.h
+ *
+ *  Copyright (c) 2001-2012 Nick Dowell
+ *
+ *  This file is part of amsynth.
+ *
+ *  amsynth is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  amsynth is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with amsynth.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _MIDI_EVENT_QUEUE_H
+#define _MIDI_EVENT_QUEUE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+struct MidiEvent
+{
+	uint64_t		time;		// microseconds, see MidiEventQueue::now()
+	unsigned char	size;
+	unsigned char	data[7];	// a fragment of the MIDI byte stream
+};
+
+/**
+ * A lock-free queue carrying MIDI input from exactly one producer thread
+ * to exactly one consumer thread (the audio thread).
+ */
+class MidiEventQueue
+{
+public:
+	MidiEventQueue() : mWrite(0), mRead(0) {}
+
+	// producer: returns false if the queue is full and the bytes were dropped.
+	// bytes are queued in fragments of up to 7, all of them or none, so that the
+	// consumer never sees part of a message
+	bool	push	(uint64_t time, const unsigned char *bytes, unsigned size)
+	{
+		const unsigned fragments = (size + sizeof(mEvents[0].data) - 1) / sizeof(mEvents[0].data);
+		unsigned write = mWrite;
+		if (kSize - (write - mRead) < fragments)
+			return false;
+		while (size) {
+			MidiEvent &event = mEvents[write & (kSize - 1)];
+			event.time = time;
+			event.size = size < sizeof(event.data) ? size : sizeof(event.data);
+			memcpy(event.data, bytes, event.size);
+			bytes += event.size;
+			size -= event.size;
+			write++;
+		}
+		__sync_synchronize(); // publish the events before the index
+		mWrite = write;
+		return true;
+	}
+
+	// consumer: the oldest event, or NULL if the queue is empty
+	const MidiEvent *	peek	() const
+	{
+		const unsigned read = mRead;
+		if (read == mWrite)
+			return NULL;
+		__sync_synchronize(); // read the event after the index
+		return &mEvents[read & (kSize - 1)];
+	}
+
+	// consumer: releases the event returned by peek()
+	void	pop		()
+	{
+		__sync_synchronize();
+		mRead = mRead + 1;
+	}
+
+	static uint64_t	now		()
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	}
+
+private:
+	static const unsigned kSize = 1024; // must be a power of two
+
+	MidiEvent			mEvents[kSize];
+	volatile unsigned	mWrite;
+	volatile unsigned	mRead;
+};
+
+#endif
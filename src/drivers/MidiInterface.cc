@@ -25,7 +25,9 @@
 #include "OSSMidiDriver.h"
 
 #include <iostream>
+#include <poll.h>
 #include <string.h>
+#include <unistd.h>
 
 #define MIDI_BUF_SIZE 64
 using namespace std;
@@ -38,6 +40,18 @@ int MidiInterface::write_cc(unsigned int channel, unsigned int param, unsigned i
 int MidiInterface::open( Config & config )
 {
 	if (midi) return 0;
+	if (openDriver(config) != 0) return -1;
+	if (Run() != 0) {
+		cerr << "<MidiInterface> could not start the MIDI input thread\n";
+		midi->close();
+		delete midi; midi = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+int MidiInterface::openDriver( Config & config )
+{
 	
 	if (config.midi_driver == "auto")
 	{
@@ -110,24 +124,77 @@ int MidiInterface::open( Config & config )
 void MidiInterface::close()
 {
 	if (midi) {
+		Stop();
+		Join();
 		midi->close();
 		delete midi;
+		midi = NULL;
 	}
 }
 
 void
-MidiInterface::poll()
+MidiInterface::ThreadAction()
 {
-	while (midi)
+	unsigned char buffer[MIDI_BUF_SIZE];
+	struct pollfd pfd;
+	pfd.fd = midi->get_poll_fd();
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	while (!ShouldStop())
 	{
-		bzero(_buffer, MIDI_BUF_SIZE);
-		int bytes_read = midi->read(_buffer, MIDI_BUF_SIZE);
-		if (_handler != NULL && bytes_read > 0) {
-			_handler->HandleMidiData(_buffer, bytes_read);
-		} else {
-			break;
+		// the timeout lets the thread notice when it should stop
+		if (pfd.fd < 0)
+			usleep(1000);
+		else if (::poll(&pfd, 1, 100) <= 0)
+			continue;
+
+		int bytes_read;
+		while ((bytes_read = midi->read(buffer, sizeof(buffer))) > 0) {
+			if (!_queue.push(MidiEventQueue::now(), buffer, bytes_read))
+				cerr << "<MidiInterface> input queue full, dropped " << bytes_read << " bytes\n";
 		}
+		// don't spin on a descriptor reporting an error or hangup
+		if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))
+			usleep(10000);
+	}
+}
+
+void
+MidiInterface::beginCycle(unsigned num_frames)
+{
+	const uint64_t now = MidiEventQueue::now();
+	_cycleStart = _cycleEnd ? _cycleEnd : now;
+	_cycleEnd = now;
+	_cycleFrames = num_frames;
+}
+
+unsigned
+MidiInterface::eventFrame(const MidiEvent &event) const
+{
+	// map the time elapsed over the previous cycle onto this cycle's frames
+	if (event.time <= _cycleStart || _cycleEnd <= _cycleStart)
+		return 0;
+	const uint64_t frame = (event.time - _cycleStart) * _cycleFrames / (_cycleEnd - _cycleStart);
+	return frame < _cycleFrames ? (unsigned)frame : _cycleFrames - 1;
+}
+
+unsigned
+MidiInterface::dispatchEvents(unsigned frame)
+{
+	const MidiEvent *event;
+	while ((event = _queue.peek()) != NULL) {
+		// events newer than the start of this cycle wait for the next one
+		if (event->time > _cycleEnd)
+			return _cycleFrames;
+		const unsigned event_frame = eventFrame(*event);
+		if (event_frame > frame)
+			return event_frame;
+		if (_handler != NULL)
+			_handler->HandleMidiData(event->data, event->size);
+		_queue.pop();
 	}
+	return _cycleFrames;
 }
 
 void MidiInterface::SetMidiStreamReceiver(MidiStreamReceiver* in)
@@ -138,15 +205,17 @@ void MidiInterface::SetMidiStreamReceiver(MidiStreamReceiver* in)
 }
 	
 MidiInterface::MidiInterface()
-:	_handler(NULL)
+:	Thread(kMidiThread)
+,	_handler(NULL)
 ,	midi(NULL)
+,	_cycleStart(0)
+,	_cycleEnd(0)
+,	_cycleFrames(0)
 {
-	_buffer = new unsigned char[MIDI_BUF_SIZE];
 }
 
 MidiInterface::~MidiInterface()
 {
-	delete[] _buffer;
     close();
 }
 
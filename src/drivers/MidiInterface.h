@@ -23,6 +23,8 @@
 #define _MidiInterface_h
 
 #include "../Config.h"
+#include "../Thread.h"
+#include "MidiEventQueue.h"
 
 class MidiStreamReceiver
 {
@@ -38,7 +40,11 @@ protected:
 };
 
 
-class MidiInterface
+/**
+ * Reads MIDI input on its own thread, timestamping it and queueing it for the
+ * audio thread, which passes it to the receiver at the matching frame offset.
+ */
+class MidiInterface : public Thread
 {
 public:
     MidiInterface();
@@ -49,16 +55,29 @@ public:
 	
 	virtual void SetMidiStreamReceiver(MidiStreamReceiver* in);
 
-	virtual void poll();
+	// Audio thread: call at the start of each cycle. Input timestamped during the
+	// previous cycle is spread across this one, giving one cycle of constant latency.
+	void beginCycle(unsigned num_frames);
+	// Audio thread: passes input due at or before frame to the receiver, and
+	// returns the frame of the next pending event, or num_frames if none remain.
+	unsigned dispatchEvents(unsigned frame);
+
     virtual int write_cc(unsigned int channel, unsigned int param, unsigned int value);
 	
 protected:
 
+	virtual void ThreadAction();
+
 	MidiStreamReceiver* _handler;
 	
 private:
+	int openDriver(Config&);
+	unsigned eventFrame(const MidiEvent &event) const;
+
 	class MidiDriver * midi;
-	unsigned char *_buffer;
+	MidiEventQueue _queue;
+	uint64_t _cycleStart, _cycleEnd;
+	unsigned _cycleFrames;
 };
 
 #endif
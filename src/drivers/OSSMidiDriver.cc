@@ -42,6 +42,7 @@ public:
 	
 	int read(unsigned char *bytes, unsigned maxBytes);
 	int write_cc(unsigned int channel, unsigned int param, unsigned int value);
+	int get_poll_fd() { return _fd; }
 	
 private:
 		int _fd;
@@ -0,0 +1,282 @@
+/*
+ *  SampleConversion.cc
+ *
+ *  Copyright (c) 2001-2012 Nick Dowell
+ *
+ *  This file is part of amsynth.
+ *
+ *  amsynth is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  amsynth is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with amsynth.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SampleConversion.h"
+
+#include "../CpuFeatures.h"
+
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+// largest floats which convert to the integer range without overflowing
+static const float kS16Max = 32767.0f;
+static const float kS24Max = 8388607.0f;
+static const float kS32Max = 2147483520.0f;
+
+SampleDither::SampleDither()
+{
+	state[0] = 0x9e3779b9;
+	state[1] = 0x7f4a7c15;
+	state[2] = 0xf39cc060;
+	state[3] = 0x5ced1a2b;
+}
+
+static inline float
+tpdf (SampleDither *dither, unsigned lane)
+{
+	uint32_t x = dither->state[lane];
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	dither->state[lane] = x;
+	// difference of two uniform variables has a triangular distribution
+	return (float)((int32_t)(x >> 16) - (int32_t)(x & 0xffff)) * (1.0f / 65536.0f);
+}
+
+static inline int32_t
+quantise (float y, float max)
+{
+	if (y < -max - 1.0f) y = -max - 1.0f;
+	if (y > max) y = max;
+	return (int32_t) lrintf (y);
+}
+
+#ifdef __SSE2__
+
+static inline __m128
+tpdf4 (__m128i &state)
+{
+	__m128i x = state;
+	x = _mm_xor_si128 (x, _mm_slli_epi32 (x, 13));
+	x = _mm_xor_si128 (x, _mm_srli_epi32 (x, 17));
+	x = _mm_xor_si128 (x, _mm_slli_epi32 (x, 5));
+	state = x;
+	__m128i d = _mm_sub_epi32 (_mm_srli_epi32 (x, 16), _mm_and_si128 (x, _mm_set1_epi32 (0xffff)));
+	return _mm_mul_ps (_mm_cvtepi32_ps (d), _mm_set1_ps (1.0f / 65536.0f));
+}
+
+// scales, dithers and clips four samples, then rounds them to integers
+static inline __m128i
+quantise4 (const float *src, __m128 scale, __m128 max, __m128i *dither)
+{
+	__m128 y = _mm_mul_ps (_mm_loadu_ps (src), scale);
+	if (dither)
+		y = _mm_add_ps (y, tpdf4 (*dither));
+	y = _mm_min_ps (y, max);
+	y = _mm_max_ps (y, _mm_sub_ps (_mm_sub_ps (_mm_setzero_ps (), max), _mm_set1_ps (1.0f)));
+	return _mm_cvtps_epi32 (y);
+}
+
+#endif
+
+#if defined(__SSE2__) && defined(X86_DISPATCH)
+
+#define AVX2 __attribute__((target("avx2")))
+
+static bool
+use_avx2 ()
+{
+	static const bool avx2 = (cpu_features () & kCpuAVX2) != 0;
+	return avx2;
+}
+
+// dither for eight samples, drawn in the same order as by two tpdf4() calls
+AVX2 static inline __m256
+tpdf8 (__m128i &state)
+{
+	__m128 lo = tpdf4 (state);
+	__m128 hi = tpdf4 (state);
+	return _mm256_insertf128_ps (_mm256_castps128_ps256 (lo), hi, 1);
+}
+
+AVX2 static inline __m256i
+quantise8 (const float *src, __m256 scale, __m256 max, __m128i *dither)
+{
+	__m256 y = _mm256_mul_ps (_mm256_loadu_ps (src), scale);
+	if (dither)
+		y = _mm256_add_ps (y, tpdf8 (*dither));
+	y = _mm256_min_ps (y, max);
+	y = _mm256_max_ps (y, _mm256_sub_ps (_mm256_sub_ps (_mm256_setzero_ps (), max), _mm256_set1_ps (1.0f)));
+	return _mm256_cvtps_epi32 (y);
+}
+
+// The AVX2 variants convert as many samples as they can in whole vectors, and
+// return how many, leaving the rest to the SSE2 and scalar code.
+
+AVX2 static unsigned
+float_to_s16_avx2 (const float *src, int16_t *dst, unsigned count, __m128i *dither)
+{
+	const __m256 scale = _mm256_set1_ps (32768.0f), max = _mm256_set1_ps (kS16Max);
+	unsigned i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m256i a = quantise8 (src + i, scale, max, dither);
+		__m256i b = quantise8 (src + i + 8, scale, max, dither);
+		// packing works within 128 bit lanes, so put the quadwords back in order
+		__m256i p = _mm256_permute4x64_epi64 (_mm256_packs_epi32 (a, b), 0xd8);
+		_mm256_storeu_si256 ((__m256i *)(dst + i), p);
+	}
+	_mm256_zeroupper (); // see MixKernels.cc
+	return i;
+}
+
+AVX2 static unsigned
+float_to_s24_3le_avx2 (const float *src, unsigned char *dst, unsigned count, __m128i *dither)
+{
+	const __m256 scale = _mm256_set1_ps (8388608.0f), max = _mm256_set1_ps (kS24Max);
+	unsigned i = 0;
+	for (; i + 8 <= count; i += 8) {
+		int32_t v[8];
+		_mm256_storeu_si256 ((__m256i *) v, quantise8 (src + i, scale, max, dither));
+		for (unsigned j = 0; j < 8; j++) {
+			*dst++ = (unsigned char)(v[j]);
+			*dst++ = (unsigned char)(v[j] >> 8);
+			*dst++ = (unsigned char)(v[j] >> 16);
+		}
+	}
+	_mm256_zeroupper (); // see MixKernels.cc
+	return i;
+}
+
+AVX2 static unsigned
+float_to_s32_avx2 (const float *src, int32_t *dst, unsigned count)
+{
+	const __m256 scale = _mm256_set1_ps (2147483648.0f), max = _mm256_set1_ps (kS32Max);
+	unsigned i = 0;
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_si256 ((__m256i *)(dst + i), quantise8 (src + i, scale, max, NULL));
+	_mm256_zeroupper (); // see MixKernels.cc
+	return i;
+}
+
+#undef AVX2
+
+#else
+
+static bool use_avx2 () { return false; }
+
+#endif
+
+const char *
+sample_conversion_isa ()
+{
+	if (use_avx2 ())
+		return cpu_feature_name (kCpuAVX2);
+#ifdef __SSE2__
+	return cpu_feature_name (kCpuSSE2);
+#else
+	return cpu_feature_name (0);
+#endif
+}
+
+void
+float_to_s16 (const float *src, int16_t *dst, unsigned count, SampleDither *dither)
+{
+	unsigned i = 0;
+#ifdef __SSE2__
+	const __m128 scale = _mm_set1_ps (32768.0f), max = _mm_set1_ps (kS16Max);
+	__m128i lanes, *d = NULL;
+	if (dither) {
+		lanes = _mm_loadu_si128 ((const __m128i *) dither->state);
+		d = &lanes;
+	}
+#ifdef X86_DISPATCH
+	if (use_avx2 ())
+		i = float_to_s16_avx2 (src, dst, count, d);
+#endif
+	for (; i + 8 <= count; i += 8) {
+		__m128i a = quantise4 (src + i, scale, max, d);
+		__m128i b = quantise4 (src + i + 4, scale, max, d);
+		_mm_storeu_si128 ((__m128i *)(dst + i), _mm_packs_epi32 (a, b));
+	}
+	if (dither)
+		_mm_storeu_si128 ((__m128i *) dither->state, lanes);
+#endif
+	for (; i < count; i++) {
+		float y = src[i] * 32768.0f;
+		if (dither)
+			y += tpdf (dither, i & 3);
+		dst[i] = (int16_t) quantise (y, kS16Max);
+	}
+}
+
+void
+float_to_s24_3le (const float *src, unsigned char *dst, unsigned count, SampleDither *dither)
+{
+	unsigned i = 0;
+#ifdef __SSE2__
+	const __m128 scale = _mm_set1_ps (8388608.0f), max = _mm_set1_ps (kS24Max);
+	__m128i lanes, *d = NULL;
+	if (dither) {
+		lanes = _mm_loadu_si128 ((const __m128i *) dither->state);
+		d = &lanes;
+	}
+#ifdef X86_DISPATCH
+	if (use_avx2 ())
+		i = float_to_s24_3le_avx2 (src, dst, count, d);
+	dst += 3 * i;
+#endif
+	for (; i + 4 <= count; i += 4) {
+		int32_t v[4];
+		_mm_storeu_si128 ((__m128i *) v, quantise4 (src + i, scale, max, d));
+		for (unsigned j = 0; j < 4; j++) {
+			*dst++ = (unsigned char)(v[j]);
+			*dst++ = (unsigned char)(v[j] >> 8);
+			*dst++ = (unsigned char)(v[j] >> 16);
+		}
+	}
+	if (dither)
+		_mm_storeu_si128 ((__m128i *) dither->state, lanes);
+#endif
+	for (; i < count; i++) {
+		float y = src[i] * 8388608.0f;
+		if (dither)
+			y += tpdf (dither, i & 3);
+		int32_t v = quantise (y, kS24Max);
+		*dst++ = (unsigned char)(v);
+		*dst++ = (unsigned char)(v >> 8);
+		*dst++ = (unsigned char)(v >> 16);
+	}
+}
+
+void
+float_to_s32 (const float *src, int32_t *dst, unsigned count)
+{
+	unsigned i = 0;
+#ifdef __SSE2__
+	const __m128 scale = _mm_set1_ps (2147483648.0f), max = _mm_set1_ps (kS32Max);
+#ifdef X86_DISPATCH
+	if (use_avx2 ())
+		i = float_to_s32_avx2 (src, dst, count);
+#endif
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_si128 ((__m128i *)(dst + i), quantise4 (src + i, scale, max, NULL));
+#endif
+	for (; i < count; i++)
+		dst[i] = quantise (src[i] * 2147483648.0f, kS32Max);
+}
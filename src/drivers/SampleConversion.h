@@ -0,0 +1,49 @@
+/*
+ *  SampleConversion.h
+ *
+ *  Copyright (c) 2001-2012 Nick Dowell
+ *
+ *  This file is part of amsynth.
+ *
+ *  amsynth is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  amsynth is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with amsynth.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SAMPLE_CONVERSION_H
+#define _SAMPLE_CONVERSION_H
+
+#include <stdint.h>
+
+/**
+ * Triangular (TPDF) dither noise of +/- 1 LSB, from four independent xorshift
+ * generators so that the SSE2 and scalar conversions produce identical output.
+ */
+struct SampleDither
+{
+	SampleDither();
+
+	uint32_t	state[4];
+};
+
+// Each function converts count float samples in the range [-1, 1] to packed
+// integer samples, rounding to nearest and clipping values out of range.
+// dither may be NULL to quantise without dither.
+
+void	float_to_s16	(const float *src, int16_t *dst, unsigned count, SampleDither *dither);
+void	float_to_s24_3le(const float *src, unsigned char *dst, unsigned count, SampleDither *dither);
+void	float_to_s32	(const float *src, int32_t *dst, unsigned count);
+
+// the instruction set used by the conversions on this CPU, e.g. "avx2"
+const char *	sample_conversion_isa	();
+
+#endif
@@ -19,11 +19,13 @@
  *  along with amsynth.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "BankLoader.h"
 #include "controls.h"
 #include "midi.h"
 #include "MidiController.h"
 #include "PresetController.h"
 #include "VoiceAllocationUnit.h"
+#include "Effects/denormals.h"
 
 #include <assert.h>
 #include <dssi.h>
@@ -32,6 +34,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <new>
 
 
 #ifdef DEBUG
@@ -45,6 +48,9 @@
 static LADSPA_Descriptor *	s_ladspaDescriptor = NULL;
 static DSSI_Descriptor *	s_dssiDescriptor   = NULL;
 
+// shared by every instance rendered by run_multiple_synths()
+static VoiceAllocationUnit::Scratch *	s_scratch = NULL;
+
 
 typedef struct _amsynth_wrapper {
 	VoiceAllocationUnit * vau;
@@ -53,6 +59,8 @@ typedef struct _amsynth_wrapper {
 	LADSPA_Data *         out_l;
 	LADSPA_Data *         out_r;
 	LADSPA_Data **        params;
+	BankLoader *          loader;
+	bool                  bank_ready;
 } amsynth_wrapper;
 
 
@@ -90,14 +98,26 @@ static LADSPA_Handle instantiate (const LADSPA_Descriptor * descriptor, unsigned
     config.Defaults();
     config.load();
     Preset amsynth_preset;
+    // exceptions mustn't propagate into the host
+    VoiceAllocationUnit *vau = NULL;
+    try {
+        vau = new VoiceAllocationUnit (config.huge_pages != 0);
+    } catch (std::bad_alloc &) {
+        fprintf (stderr, "[amsynth-dssi] could not allocate the synthesis state\n");
+        return NULL;
+    }
     amsynth_wrapper * a = new amsynth_wrapper;
-    a->vau = new VoiceAllocationUnit;
+    a->vau = vau;
+    a->vau->lockMemory ();
     a->vau->SetSampleRate (s_rate);
     a->vau->setPitchBendRangeSemitones (config.pitch_bend_range);
+    a->vau->setQuality (quality_from_name (config.quality.c_str()));
+    a->vau->setBlockSize (config.block_size);
     a->bank = new PresetController;
-    a->bank->loadPresets(config.current_bank_file.c_str());
-    a->bank->selectPreset(0);
     a->bank->getCurrentPreset().AddListenerToAll (a->vau);
+    a->loader = new BankLoader;
+    a->loader->load(config.current_bank_file, 0);
+    a->bank_ready = false;
     a->mc = new MidiController(config);
     a->mc->SetMidiEventHandler(a->vau);
     a->mc->setPresetController(*a->bank);
@@ -110,6 +130,7 @@ static void cleanup (LADSPA_Handle instance)
 {
 	TRACE();
     amsynth_wrapper * a = (amsynth_wrapper *) instance;
+    delete a->loader;
     delete a->vau;
     delete a->bank;
     delete a->mc;
@@ -117,6 +138,48 @@ static void cleanup (LADSPA_Handle instance)
     delete a;
 }
 
+//////////////////// Bank loading //////////////////////////////////////////////
+
+// The bank is read by a->loader, whose thread exits once it has been read,
+// so idle instances don't keep a thread each. Until the plugin is activated,
+// it may be applied from the host's (non-realtime) thread, blocking if necessary.
+// After that only run_synth() applies it, and never waits.
+
+static void wait_for_bank (amsynth_wrapper *a)
+{
+	if (!a->bank_ready) {
+		a->loader->wait();
+		a->loader->apply(*a->bank);
+		a->bank_ready = true;
+	}
+}
+
+static void activate (LADSPA_Handle instance)
+{
+	TRACE();
+	wait_for_bank ((amsynth_wrapper *) instance);
+}
+
+//////////////////// Configuration /////////////////////////////////////////////
+
+// key "quality" sets the synthesis quality: "eco", "standard" or "high".
+// It may be changed while running, taking effect at the next run_synth()
+static char *configure (LADSPA_Handle instance, const char *key, const char *value)
+{
+	TRACE_ARGS("%s = %s", key, value);
+	amsynth_wrapper * a = (amsynth_wrapper *) instance;
+	if (strcmp(key, "quality") == 0) {
+		if (strcmp(value, "eco") && strcmp(value, "standard") && strcmp(value, "high"))
+			return strdup("quality must be one of eco, standard or high");
+		a->vau->setQuality (quality_from_name (value));
+		return NULL;
+	}
+	// reserved keys are informational, the plugin needn't use them
+	if (strncmp(key, DSSI_RESERVED_CONFIGURE_PREFIX, strlen(DSSI_RESERVED_CONFIGURE_PREFIX)) == 0)
+		return NULL;
+	return strdup("unknown configure key");
+}
+
 //////////////////// Program handling //////////////////////////////////////////
 
 static const DSSI_Program_Descriptor *get_program(LADSPA_Handle Instance, unsigned long Index)
@@ -126,8 +189,10 @@ static const DSSI_Program_Descriptor *get_program(LADSPA_Handle Instance, unsign
 	static DSSI_Program_Descriptor descriptor;
 	memset(&descriptor, 0, sizeof(descriptor));
 
+	wait_for_bank (a);
+
 	if (Index < PresetController::kNumPresets) {
-		Preset &preset = a->bank->getPreset(Index);
+		const Preset &preset = a->bank->getPreset(Index);
 		descriptor.Bank = 0;
 		descriptor.Program = Index;
 		descriptor.Name = preset.getName().c_str();
@@ -148,7 +213,7 @@ static void select_program(LADSPA_Handle Instance, unsigned long Bank, unsigned
 		a->bank->selectPreset(Index);
 		// now update DSSI host's view of the parameters
 		for (unsigned int i=0; i<kAmsynthParameterCount; i++) {
-			float value = a->bank->getCurrentPreset().getParameter(i).getValue();
+			float value = a->bank->getCurrentPreset().getValue(i);
 			if (*(a->params[i]) != value) {
 				*(a->params[i]) = value;
 			}
@@ -175,66 +240,71 @@ static void connect_port (LADSPA_Handle instance, unsigned long port, LADSPA_Dat
 
 const float kMidiScaler = (1. / 127.);
 
-static void run_synth (LADSPA_Handle instance, unsigned long sample_count, snd_seq_event_t *events, unsigned long event_count)
+static void handle_events (amsynth_wrapper *a, snd_seq_event_t *events, unsigned long event_count)
 {
-    amsynth_wrapper * a = (amsynth_wrapper *) instance;
+    if (!a->bank_ready && a->loader->apply(*a->bank))
+        a->bank_ready = true;
 
     Preset &preset = a->bank->getCurrentPreset();
 
+	// the whole block is applied as one batch, see MidiController::HandleMidiMessages()
+	MidiMessage messages[256];
+	unsigned message_count = 0;
+	bool update_ports = false;
 	for (snd_seq_event_t *e = events; e < events + event_count; e++) {
-		unsigned char data[3] = {0};
+		MidiMessage &message = messages[message_count];
+		message.frame = e->time.tick;
 		switch (e->type) {
 		case SND_SEQ_EVENT_NOTEON:
-			data[0] = MIDI_STATUS_NOTE_ON;
-			data[1] = e->data.note.note;
-			data[2] = e->data.note.velocity;
-			a->mc->HandleMidiData(data, 3);
+			message.status = MIDI_STATUS_NOTE_ON | (e->data.note.channel & 0x0f);
+			message.data1 = e->data.note.note;
+			message.data2 = e->data.note.velocity;
 			break;
 		case SND_SEQ_EVENT_NOTEOFF:
-			data[0] = MIDI_STATUS_NOTE_OFF;
-			data[1] = e->data.note.note;
-			data[2] = e->data.note.off_velocity;
-			a->mc->HandleMidiData(data, 3);
+			message.status = MIDI_STATUS_NOTE_OFF | (e->data.note.channel & 0x0f);
+			message.data1 = e->data.note.note;
+			message.data2 = e->data.note.off_velocity;
 			break;
 		case SND_SEQ_EVENT_KEYPRESS:
-			data[0] = MIDI_STATUS_NOTE_PRESSURE;
-			data[1] = e->data.note.note;
-			data[2] = e->data.note.velocity;
-			a->mc->HandleMidiData(data, 3);
+			message.status = MIDI_STATUS_NOTE_PRESSURE | (e->data.note.channel & 0x0f);
+			message.data1 = e->data.note.note;
+			message.data2 = e->data.note.velocity;
 			break;
 		case SND_SEQ_EVENT_CONTROLLER:
-			data[0] = MIDI_STATUS_CONTROLLER;
-			data[1] = e->data.control.param;
-			data[2] = e->data.control.value;
-			a->mc->HandleMidiData(data, 3);
-			for (unsigned int i=0; i<kAmsynthParameterCount; i++) {
-				float value = preset.getParameter(i).getValue();
-				if (*(a->params[i]) != value) {
-					*(a->params[i]) = value;
-				}
-			}
+			message.status = MIDI_STATUS_CONTROLLER | (e->data.control.channel & 0x0f);
+			message.data1 = e->data.control.param;
+			message.data2 = e->data.control.value;
+			update_ports = true;
 			break;
 		case SND_SEQ_EVENT_PGMCHANGE:
-			data[0] = MIDI_STATUS_PROGRAM_CHANGE;
-			data[1] = e->data.control.value;
-			a->mc->HandleMidiData(data, 2);
-			for (unsigned int i=0; i<kAmsynthParameterCount; i++) {
-				float value = preset.getParameter(i).getValue();
-				if (*(a->params[i]) != value) {
-					*(a->params[i]) = value;
-				}
-			}
-			break;
-		case SND_SEQ_EVENT_CHANPRESS:
+			message.status = MIDI_STATUS_PROGRAM_CHANGE | (e->data.control.channel & 0x0f);
+			message.data1 = e->data.control.value;
+			message.data2 = 0;
+			update_ports = true;
 			break;
 		case SND_SEQ_EVENT_PITCHBEND:
-			data[0] = MIDI_STATUS_PITCH_WHEEL;
-			data[1] = (((unsigned int)(e->data.control.value + 0x2000)) >> 0) & 0x7F;
-			data[2] = (((unsigned int)(e->data.control.value + 0x2000)) >> 7) & 0x7F;
-			a->mc->HandleMidiData(data, 3);
+			message.status = MIDI_STATUS_PITCH_WHEEL | (e->data.control.channel & 0x0f);
+			message.data1 = (((unsigned int)(e->data.control.value + 0x2000)) >> 0) & 0x7F;
+			message.data2 = (((unsigned int)(e->data.control.value + 0x2000)) >> 7) & 0x7F;
 			break;
+		case SND_SEQ_EVENT_CHANPRESS:
 		default:
-			break;
+			continue;
+		}
+		if (++message_count == sizeof(messages) / sizeof(messages[0])) {
+			a->mc->HandleMidiMessages(messages, message_count);
+			message_count = 0;
+		}
+	}
+	a->mc->HandleMidiMessages(messages, message_count);
+
+	// controllers and program changes alter parameters, which the host's ports must reflect
+	if (update_ports) {
+		for (unsigned int i=0; i<kAmsynthParameterCount; i++) {
+			float value = preset.getValue(i);
+			if (*(a->params[i]) != value) {
+				*(a->params[i]) = value;
+			}
 		}
 	}
 
@@ -242,16 +312,39 @@ static void run_synth (LADSPA_Handle instance, unsigned long sample_count, snd_s
     for (unsigned i=0; i<kAmsynthParameterCount; i++)
     {
 		const LADSPA_Data host_value = *(a->params[i]);
-	    if (preset.getParameter(i).getValue() != host_value)
+	    if (preset.getValue(i) != host_value)
 	    {
-			TRACE_ARGS("parameter %32s = %f", preset.getParameter(i).getName().c_str(), host_value);
-		    preset.getParameter(i).setValue(host_value);
+			TRACE_ARGS("parameter %32s = %f", parameter_name_from_index(i), host_value);
+		    preset.setValue(i, host_value);
 	    }
     }
+}
 
+static void run_synth (LADSPA_Handle instance, unsigned long sample_count, snd_seq_event_t *events, unsigned long event_count)
+{
+    amsynth_wrapper * a = (amsynth_wrapper *) instance;
+    DenormalGuard denormal_guard;
+    handle_events (a, events, event_count);
     a->vau->Process ((float *) a->out_l, (float *) a->out_r, sample_count);
 }
 
+// Hosts using this call it once per block with every amsynth instance, from one thread.
+// All the instances are rendered back to back through the same scratch memory, so it
+// stays in cache, rather than each instance touching its own.
+
+static void run_multiple_synths (unsigned long instance_count, LADSPA_Handle *instances, unsigned long sample_count,
+                                 snd_seq_event_t **events, unsigned long *event_counts)
+{
+    DenormalGuard denormal_guard;
+    for (unsigned long i = 0; i < instance_count; i++)
+        handle_events ((amsynth_wrapper *) instances[i], events[i], event_counts[i]);
+
+    for (unsigned long i = 0; i < instance_count; i++) {
+        amsynth_wrapper * a = (amsynth_wrapper *) instances[i];
+        a->vau->Process ((float *) a->out_l, (float *) a->out_r, sample_count, 1, *s_scratch);
+    }
+}
+
 // renoise ignores DSSI plugins that don't implement run
 
 static void run (LADSPA_Handle instance, unsigned long sample_count)
@@ -342,7 +435,7 @@ void __attribute__ ((constructor)) my_init ()
 		s_ladspaDescriptor->instantiate = instantiate;
 		s_ladspaDescriptor->cleanup = cleanup;
 
-		s_ladspaDescriptor->activate = NULL;
+		s_ladspaDescriptor->activate = activate;
 		s_ladspaDescriptor->deactivate = NULL;
 
 		s_ladspaDescriptor->connect_port = connect_port;
@@ -351,19 +444,21 @@ void __attribute__ ((constructor)) my_init ()
 		s_ladspaDescriptor->set_run_adding_gain = NULL;
     }
 
+	s_scratch = VoiceAllocationUnit::createScratch ();
+
 	/* DSSI descriptor */
     s_dssiDescriptor = (DSSI_Descriptor *) malloc (sizeof (DSSI_Descriptor));
     if (s_dssiDescriptor)
 	{
 		s_dssiDescriptor->DSSI_API_Version				= 1;
 		s_dssiDescriptor->LADSPA_Plugin				= s_ladspaDescriptor;
-		s_dssiDescriptor->configure					= NULL;
+		s_dssiDescriptor->configure					= configure;
 		s_dssiDescriptor->get_program 					= get_program;
 		s_dssiDescriptor->get_midi_controller_for_port	= NULL;
 		s_dssiDescriptor->select_program 				= select_program;
 		s_dssiDescriptor->run_synth 					= run_synth;
 		s_dssiDescriptor->run_synth_adding 			= NULL;
-		s_dssiDescriptor->run_multiple_synths 			= NULL;
+		s_dssiDescriptor->run_multiple_synths 			= run_multiple_synths;
 		s_dssiDescriptor->run_multiple_synths_adding	= NULL;
     }
 }
@@ -381,4 +476,5 @@ void __attribute__ ((destructor)) my_fini ()
 	{
 		free (s_dssiDescriptor);
     }
+    VoiceAllocationUnit::destroyScratch (s_scratch);
 }
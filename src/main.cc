@@ -20,12 +20,19 @@
  */
 
 #include "main.h"
+#include "BankLoader.h"
 #include "GUI/gui_main.h"
 #include "MidiController.h"
 #include "VoiceAllocationUnit.h"
 #include "AudioOutput.h"
 #include "JackOutput.h"
 #include "Config.h"
+#include "CpuFeatures.h"
+#include "Metrics.h"
+#include "Thread.h"
+#include "VoiceBoard/MixKernels.h"
+#include "VoiceBoard/VoiceBoard.h"
+#include "drivers/SampleConversion.h"
 #include "../config.h"
 #include "lash.h"
 
@@ -33,6 +40,7 @@
 #include "drivers/CoreAudio.h"
 #endif
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <unistd.h>
@@ -43,6 +51,10 @@
 #include <sys/resource.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sched.h>
+#include <string.h>
+#include <errno.h>
 
 #include "Effects/denormals.h"
 
@@ -101,6 +113,45 @@ void sched_realtime()
 }
 #endif
 
+// applies the thread settings from config to every thread started afterwards
+static void
+configure_threads ()
+{
+	const struct { ThreadClass threadClass; const char *name; const string &scheduling, &cpus; } classes[] = {
+		{ kAudioThread, "audio", config.audio_thread_scheduling, config.audio_thread_cpus },
+		{ kMidiThread, "midi", config.midi_thread_scheduling, config.midi_thread_cpus },
+		{ kWorkerThread, "worker", config.worker_thread_scheduling, config.worker_thread_cpus },
+	};
+	for (unsigned i = 0; i < sizeof(classes) / sizeof(classes[0]); i++) {
+		ThreadSchedule schedule;
+		if (schedule.parse (classes[i].scheduling, classes[i].cpus))
+			Thread::setSchedule (classes[i].threadClass, schedule);
+		else
+			cerr << "ignoring invalid " << classes[i].name << "_thread_scheduling or _cpus: '"
+			     << classes[i].scheduling << "' '" << classes[i].cpus << "'\n";
+	}
+
+	if (config.lock_memory && mlockall (MCL_CURRENT | MCL_FUTURE) != 0)
+		cerr << "could not lock memory: " << strerror (errno) << " (check RLIMIT_MEMLOCK)\n";
+
+#ifdef __linux__
+	// threads inherit the affinity of the one which creates them, so taking the
+	// audio CPUs away from this one keeps all the others (GUI, MIDI, disk) off them
+	const vector<int> &audio_cpus = Thread::getSchedule (kAudioThread).cpus;
+	if (config.isolate_audio_cpus && !audio_cpus.empty()) {
+		cpu_set_t set;
+		CPU_ZERO (&set);
+		sched_getaffinity (0, sizeof(set), &set);
+		for (size_t i = 0; i < audio_cpus.size(); i++)
+			if (audio_cpus[i] < CPU_SETSIZE)
+				CPU_CLR (audio_cpus[i], &set);
+		int err = CPU_COUNT (&set) ? pthread_setaffinity_np (pthread_self (), sizeof(set), &set) : EINVAL;
+		if (err)
+			cerr << "could not isolate the audio CPUs: " << strerror (err) << "\n";
+	}
+#endif
+}
+
 int fcopy (const char * dest, const char *source)
 {
 	FILE *in = fopen (source,"r");
@@ -177,7 +228,10 @@ void ptest ();
 static MidiController *midi_controller = NULL;
 static MidiInterface *midiInterface = NULL;
 static PresetController *presetController = NULL;
+static BankLoader *bankLoader = NULL;
 static VoiceAllocationUnit *voiceAllocationUnit = NULL;
+static MetricsExport *metrics = NULL;
+static GenericOutput *audioOutput = NULL;
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -308,6 +362,8 @@ int main( int argc, char *argv[] )
 	config.Defaults ();
 	config.load ();
 	config.ParseCOpts (argc, argv);
+
+	configure_threads ();
 	
 	if (config.debug_drivers)
 		cout << "\n*** CONFIGURATION:\n"
@@ -323,6 +379,7 @@ int main( int argc, char *argv[] )
 	//
 	
 	presetController = new PresetController();
+	bankLoader = new BankLoader();
 	
 	midi_controller = new MidiController( config );
 
@@ -330,18 +387,38 @@ int main( int argc, char *argv[] )
 	if (!out)
 		fatal_error("Fatal Error: open_audio() returned NULL.\n"
 		            "config.audio_driver = " + config.audio_driver);
+	audioOutput = out;
 
 	// errors now detected & reported in the GUI
 	out->init(config);
 
-	voiceAllocationUnit = new VoiceAllocationUnit;
+	voiceAllocationUnit = new VoiceAllocationUnit (config.huge_pages != 0);
+	if (!voiceAllocationUnit->lockMemory () && config.debug_drivers)
+		std::cerr << "could not lock the synthesis engine's memory, check RLIMIT_MEMLOCK\n";
 	voiceAllocationUnit->SetSampleRate (config.sample_rate);
+	voiceAllocationUnit->setBlockSize (config.block_size);
 	voiceAllocationUnit->SetMaxVoices (config.polyphony);
+	voiceAllocationUnit->setPolyphonyGovernor (config.polyphony_governor != 0);
+	voiceAllocationUnit->setQuality (quality_from_name (config.quality.c_str()));
 	voiceAllocationUnit->setPitchBendRangeSemitones (config.pitch_bend_range);
+	if (config.export_metrics) {
+		metrics = new MetricsExport;
+		if (metrics->open ()) {
+			voiceAllocationUnit->setStageTiming (true);
+			if (config.debug_drivers) std::cerr << "publishing statistics in " << metrics->name () << "\n";
+		} else {
+			std::cerr << "could not create shared memory for statistics: " << strerror (errno) << "\n";
+			delete metrics;
+			metrics = NULL;
+		}
+	}
 	out->setAudioCallback (&amsynth_audio_callback);
 
-	amsynth_load_bank(config.current_bank_file.c_str());
-	amsynth_set_preset_number(initial_preset_no);
+	// the first bank is in place before audio starts, later ones are applied by amsynth_timer_callback()
+	amsynth_load_bank_preset(config.current_bank_file.c_str(), initial_preset_no);
+	bankLoader->wait();
+	if (!bankLoader->apply(*presetController))
+		amsynth_set_preset_number(initial_preset_no);
 	
 	// errors now detected & reported in the GUI
 	out->Start();
@@ -398,8 +475,10 @@ int main( int argc, char *argv[] )
 	} else {
 		printf("amsynth running in headless mode, press ctrl-c to exit\n");
 		signal(SIGINT, &signal_handler);
-		while (!signal_received)
-			sleep(2); // delivery of a signal will wake us early
+		while (!signal_received) {
+			sleep(1); // delivery of a signal will wake us early
+			amsynth_timer_callback();
+		}
 		printf("shutting down...\n");
 	}
 
@@ -407,9 +486,11 @@ int main( int argc, char *argv[] )
 
 	if (config.xruns) std::cerr << config.xruns << " audio buffer underruns occurred\n";
 
+	delete bankLoader;
 	delete presetController;
 	delete midi_controller;
 	delete voiceAllocationUnit;
+	delete metrics;
 	delete out;
 	return 0;
 }
@@ -419,17 +500,65 @@ amsynth_timer_callback()
 {
 	amsynth_lash_poll_events();
 	midi_controller->timer_callback();
+	bankLoader->apply(*presetController);
 	return 1;
 }
 
+// called from the audio thread, after rendering
+static void
+publish_metrics()
+{
+	VoiceAllocationUnit::Stats stats;
+	voiceAllocationUnit->getStats(stats);
+	config.active_voices = stats.activeVoices;
+
+	MetricsSnapshot snapshot;
+	memset(&snapshot, 0, sizeof(snapshot));
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	snapshot.time = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	snapshot.flags = kMetricsStageTimes;
+	snapshot.sample_rate = config.sample_rate;
+	snapshot.active_voices = stats.activeVoices;
+	snapshot.max_voices = voiceAllocationUnit->getEffectiveMaxVoices();
+	snapshot.voices_stolen = stats.voicesStolen;
+	snapshot.frames = stats.frames;
+	for (int i = 0; i < kMetricsStageCount; i++)
+		snapshot.render_ns[i] = stats.stageTime[i];
+	snapshot.xruns = config.xruns;
+	snapshot.midi_events = midi_controller->getMessageCount();
+	snapshot.parameter_changes = stats.parameterChanges;
+#ifndef NDEBUG
+	snapshot.flags |= kMetricsDenormalCount;
+	snapshot.denormal_blocks = denormal_incidence();
+#endif
+	snapshot.driver_dsp_load = config.dsp_load;
+	metrics->publish(snapshot);
+}
+
 void
 amsynth_audio_callback(float *buffer_l, float *buffer_r, unsigned num_frames, int stride)
 {
-	if (midiInterface != NULL)
-		midiInterface->poll();
+	if (voiceAllocationUnit == NULL)
+		return;
+
+	DenormalGuard denormal_guard; // JACK's process thread isn't ours
+
+	// render up to each MIDI event, from the MIDI driver or the audio output (JACK),
+	// so that it takes effect at its own frame
+	if (midiInterface)
+		midiInterface->beginCycle(num_frames);
+	unsigned frame = 0;
+	while (frame < num_frames) {
+		unsigned next = audioOutput->dispatchMidi(frame, num_frames);
+		if (midiInterface)
+			next = std::min(next, midiInterface->dispatchEvents(frame));
+		voiceAllocationUnit->Process(buffer_l + frame * stride, buffer_r + frame * stride, next - frame, stride);
+		frame = next;
+	}
 
-	if (voiceAllocationUnit != NULL)
-		voiceAllocationUnit->Process(buffer_l, buffer_r, num_frames, stride);
+	if (metrics)
+		publish_metrics();
 }
 
 void
@@ -449,8 +578,14 @@ amsynth_save_bank(const char *filename)
 void
 amsynth_load_bank(const char *filename)
 {
-	presetController->loadPresets(filename);
-	presetController->selectPreset(presetController->getCurrPresetNumber());
+	// the bank is swapped in by amsynth_timer_callback() once loaded
+	bankLoader->load(filename);
+}
+
+void
+amsynth_load_bank_preset(const char *filename, int preset_no)
+{
+	bankLoader->load(filename, preset_no);
 }
 
 int
@@ -465,51 +600,110 @@ amsynth_set_preset_number(int preset_no)
 	presetController->selectPreset(preset_no);
 }
 
-///////////////////////////////////////////////////////////////////////////////
+void
+amsynth_set_sample_rate(int sample_rate)
+{
+	config.sample_rate = sample_rate;
+	if (voiceAllocationUnit)
+		voiceAllocationUnit->SetSampleRate(sample_rate);
+}
 
-void ptest ()
+void
+amsynth_set_freewheel(int freewheel)
 {
-	//
-	// test parameters
-	// 
-	const int kTestBufSize = 256;
-	const int kTestSampleRate = 44100;
-	const int kTimeSeconds = 60;
-	const int kNumVoices = 10;
+	// render time doesn't matter when not running in realtime, but throughput
+	// does; larger blocks render faster at the cost of coarser modulation
+	if (voiceAllocationUnit) {
+		voiceAllocationUnit->setPolyphonyGovernor(!freewheel && config.polyphony_governor);
+		voiceAllocationUnit->setBlockSize(freewheel ? (unsigned) VoiceBoard::kMaxProcessBufferSize : config.block_size);
+	}
+}
 
+///////////////////////////////////////////////////////////////////////////////
+
+//
+// test parameters
+// 
+static const int kTestBufSize = 256;
+static const int kTestSampleRate = 44100;
+static const int kTestNumVoices = 10;
+
+// renders seconds of audio with the given block size, returning the CPU time taken
+static void ptest_run (unsigned block_size, int seconds, unsigned long *user_usec, unsigned long *syst_usec)
+{
 	float *buffer = new float [kTestBufSize];
 
 	VoiceAllocationUnit *voiceAllocationUnit = new VoiceAllocationUnit;
 	voiceAllocationUnit->SetSampleRate (kTestSampleRate);
+	voiceAllocationUnit->setBlockSize (block_size);
+
+	// the default preset, an engine with no parameters applied renders NaNs
+	Preset preset;
+	preset.AddListenerToAll (voiceAllocationUnit);
 	
 	// trigger off some notes for amSynth to render.
-	for (int v=0; v<kNumVoices; v++) voiceAllocationUnit->HandleMidiNoteOn (60+v, 127);
+	for (int v=0; v<kTestNumVoices; v++) voiceAllocationUnit->HandleMidiNoteOn (60+v, 127);
 	
 	struct rusage usage_before; 
 	getrusage (RUSAGE_SELF, &usage_before);
 	
-	long total_samples = kTestSampleRate * kTimeSeconds;
+	long total_samples = kTestSampleRate * seconds;
 	long total_calls = total_samples / kTestBufSize;
 	long remain_samples = total_samples % kTestBufSize;
-	for (int i=0; i<total_calls; i++) voiceAllocationUnit->Process (buffer, buffer, kTestBufSize);
-	voiceAllocationUnit->Process (buffer, buffer, remain_samples);
+	for (int i=0; i<total_calls; i++) {
+		DenormalGuard denormal_guard;
+		voiceAllocationUnit->Process (buffer, buffer, kTestBufSize);
+	}
+	{
+		DenormalGuard denormal_guard;
+		voiceAllocationUnit->Process (buffer, buffer, remain_samples);
+	}
 
 	struct rusage usage_after; 
 	getrusage (RUSAGE_SELF, &usage_after);
 	
-	unsigned long user_usec = (usage_after.ru_utime.tv_sec*1000000 + usage_after.ru_utime.tv_usec)
-							- (usage_before.ru_utime.tv_sec*1000000 + usage_before.ru_utime.tv_usec);
+	*user_usec = (usage_after.ru_utime.tv_sec*1000000 + usage_after.ru_utime.tv_usec)
+			   - (usage_before.ru_utime.tv_sec*1000000 + usage_before.ru_utime.tv_usec);
 	
-	unsigned long syst_usec = (usage_after.ru_stime.tv_sec*1000000 + usage_after.ru_stime.tv_usec)
-							- (usage_before.ru_stime.tv_sec*1000000 + usage_before.ru_stime.tv_usec);
+	*syst_usec = (usage_after.ru_stime.tv_sec*1000000 + usage_after.ru_stime.tv_usec)
+			   - (usage_before.ru_stime.tv_sec*1000000 + usage_before.ru_stime.tv_usec);
 
-	unsigned long usec_audio = kTimeSeconds * kNumVoices * 1000000;
+	delete [] buffer;
+	delete voiceAllocationUnit;
+}
+
+void ptest ()
+{
+	const int kTimeSeconds = 60;
+	const int kSweepSeconds = 10;
+
+	unsigned long user_usec, syst_usec;
+	ptest_run (VoiceAllocationUnit::kDefaultBlockSize, kTimeSeconds, &user_usec, &syst_usec);
+
+	unsigned long usec_audio = kTimeSeconds * kTestNumVoices * 1000000;
 	unsigned long usec_cpu = user_usec + syst_usec;
 	
 	fprintf (stderr, "user time: %f		system time: %f\n", user_usec/1000000.f, syst_usec/1000000.f);
 	fprintf (stderr, "performance index: %f\n", (float) usec_audio / (float) usec_cpu);
-	
-	delete [] buffer;
-	delete voiceAllocationUnit;
+	fprintf (stderr, "cpu features: %s\n", cpu_features_string (cpu_features ()).c_str());
+	fprintf (stderr, "mix kernels: %s		sample conversion: %s\n", mix_kernels_isa (), sample_conversion_isa ());
+#ifndef NDEBUG
+	fprintf (stderr, "blocks with denormals flushed: %lu of %ld\n", denormal_incidence (),
+			 (long) kTestSampleRate * kTimeSeconds / kTestBufSize + 1);
+#endif
+
+	// the best block_size for .amSynthrc depends on the CPU's caches
+	unsigned best_block_size = 0;
+	float best_index = 0;
+	for (unsigned block_size = 16; block_size <= VoiceBoard::kMaxProcessBufferSize; block_size *= 2) {
+		ptest_run (block_size, kSweepSeconds, &user_usec, &syst_usec);
+		float index = (float) (kSweepSeconds * kTestNumVoices * 1000000) / (float) (user_usec + syst_usec);
+		fprintf (stderr, "block size %3u: performance index %f\n", block_size, index);
+		if (index > best_index) {
+			best_index = index;
+			best_block_size = block_size;
+		}
+	}
+	fprintf (stderr, "best block size: %u\n", best_block_size);
 }
 
@@ -28,8 +28,14 @@ extern "C" {
 
 extern void amsynth_save_bank(const char *filename);
 extern void amsynth_load_bank(const char *filename);
+// loads filename in the background, then selects preset_no from it
+extern void amsynth_load_bank_preset(const char *filename, int preset_no);
 extern int  amsynth_get_preset_number();
 extern void amsynth_set_preset_number(int preset_no);
+// called by the audio driver if its sample rate changes while running
+extern void amsynth_set_sample_rate(int sample_rate);
+// called by the audio driver when it starts or stops rendering faster than realtime
+extern void amsynth_set_freewheel(int freewheel);
 
 extern void amsynth_audio_callback(float *buffer_l, float *buffer_r, unsigned num_frames, int stride);
 extern void amsynth_midi_callback(unsigned timestamp, unsigned num_bytes, unsigned char *midi_data);
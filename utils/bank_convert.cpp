@@ -0,0 +1,42 @@
+//
+// Converts an amsynth preset bank between the text and binary formats.
+//
+// usage: bank_convert [-b|-t] <input bank> <output bank>
+//
+//   -b   write a binary bank (the default)
+//   -t   write a text bank
+//
+// The input format is detected automatically. To build, from the src directory:
+//
+//   g++ -DPKGDATADIR=\"\" -I. ../utils/bank_convert.cpp BinaryBank.cc Parameter.cc Preset.cc PresetController.cc -o bank_convert -lpthread
+//
+
+#include "PresetController.h"
+
+#include <cstdio>
+#include <cstring>
+
+int main (int argc, char *argv[])
+{
+	bool binary = true;
+	int arg = 1;
+	if (arg < argc && !strcmp(argv[arg], "-b")) { binary = true;  arg++; }
+	if (arg < argc && !strcmp(argv[arg], "-t")) { binary = false; arg++; }
+	if (argc - arg != 2) {
+		fprintf(stderr, "usage: %s [-b|-t] <input bank> <output bank>\n", argv[0]);
+		return 1;
+	}
+
+	PresetController bank;
+	if (bank.loadPresets(argv[arg]) != 0) {
+		fprintf(stderr, "error: could not load bank '%s'\n", argv[arg]);
+		return 1;
+	}
+
+	int result = binary ? bank.savePresetsBinary(argv[arg + 1]) : bank.savePresets(argv[arg + 1]);
+	if (result != 0) {
+		fprintf(stderr, "error: could not write bank '%s'\n", argv[arg + 1]);
+		return 1;
+	}
+	return 0;
+}